@@ -0,0 +1,194 @@
+// Native benchmark for the pca9535bank chip: the same kind of
+// traffic as bench.c, spread over every device in the bank, so
+// per-device costs can be compared with separate chip instances.
+//
+//   make bank-bench       (or: make bank-bench BENCH_OPS=10000000)
+//
+// SPDX-License-Identifier: MIT
+
+#include "mock_wokwi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BASE_ADDRESS  0x20
+#define NUM_DEVICES   8
+
+#define REG_INPUT0     0
+#define REG_OUTPUT0    2
+#define REG_CONFIG0    6
+
+#define SIM_NS_PER_OP  1000
+
+static const i2c_config_t *devs[NUM_DEVICES];
+static pin_t ioPins[NUM_DEVICES][16];
+static pin_t intPins[NUM_DEVICES];
+
+
+static uint64_t wallNs(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void i2cWrite(int d, const uint8_t *bytes, int count) {
+  const i2c_config_t *dev = devs[d];
+  dev->connect(dev->user_data, BASE_ADDRESS + d, false);
+  for (int i=0; i<count; i++) {
+    dev->write(dev->user_data, bytes[i]);
+  }
+  dev->disconnect(dev->user_data);
+}
+
+static uint16_t i2cRead(int d, uint8_t reg) {
+  const i2c_config_t *dev = devs[d];
+  dev->connect(dev->user_data, BASE_ADDRESS + d, false);
+  dev->write(dev->user_data, reg);
+  dev->connect(dev->user_data, BASE_ADDRESS + d, true);
+  uint16_t value = dev->read(dev->user_data);
+  value |= (uint16_t)dev->read(dev->user_data) << 8;
+  dev->disconnect(dev->user_data);
+  return value;
+}
+
+static uint8_t i2cReadByte(int d, uint8_t reg) {
+  const i2c_config_t *dev = devs[d];
+  dev->connect(dev->user_data, BASE_ADDRESS + d, false);
+  dev->write(dev->user_data, reg);
+  dev->connect(dev->user_data, BASE_ADDRESS + d, true);
+  uint8_t value = dev->read(dev->user_data);
+  dev->disconnect(dev->user_data);
+  return value;
+}
+
+
+typedef void (*scenario_fn_t)(uint64_t iteration);
+
+static void scenarioReadInputs(uint64_t i) {
+  (void)i2cRead(i % NUM_DEVICES, REG_INPUT0);
+}
+
+static void scenarioToggleOutputBit(uint64_t i) {
+  const uint8_t out[] = {REG_OUTPUT0, ((i / NUM_DEVICES) & 1) ? 0x7f : 0xff, 0xff};
+  i2cWrite(i % NUM_DEVICES, out, sizeof(out));
+}
+
+static void scenarioSingleEdge(uint64_t i) {
+  mock_drive_pin(ioPins[i % NUM_DEVICES][15], (i / NUM_DEVICES) & 1);
+}
+
+static void scenarioEdgeThenRead(uint64_t i) {
+  int d = i % NUM_DEVICES;
+  mock_drive_pin(ioPins[d][15], (i / NUM_DEVICES) & 1);
+  (void)i2cRead(d, REG_INPUT0);
+}
+
+
+typedef struct {
+  const char *name;
+  scenario_fn_t run;
+} scenario_t;
+
+static const scenario_t scenarios[] = {
+  {"read inputs, round robin", scenarioReadInputs},
+  {"toggle one output bit, round robin", scenarioToggleOutputBit},
+  {"single input edge, round robin", scenarioSingleEdge},
+  {"edge then read, round robin", scenarioEdgeThenRead},
+};
+
+/*
+  The read-clears-nINT handshake actually happened on each device,
+  and only for the port that was read.
+*/
+static int checkInterrupts(void) {
+  for (int d=0; d<NUM_DEVICES; d++) {
+    mock_drive_pin(ioPins[d][0], 1);
+    if (mock_pin_mode(intPins[d]) != OUTPUT_LOW) {
+      fprintf(stderr, "device %d: nINT not asserted after an edge\n", d);
+      return 1;
+    }
+    (void)i2cRead(d, REG_INPUT0);
+    if (mock_pin_mode(intPins[d]) == OUTPUT_LOW) {
+      fprintf(stderr, "device %d: nINT still asserted after a read\n", d);
+      return 1;
+    }
+    mock_drive_pin(ioPins[d][15], 1);
+    (void)i2cReadByte(d, REG_INPUT0);
+    if (mock_pin_mode(intPins[d]) != OUTPUT_LOW) {
+      fprintf(stderr, "device %d: port 1 change cleared by a port 0 read\n", d);
+      return 1;
+    }
+    (void)i2cRead(d, REG_INPUT0);
+
+    // a pin turned output doesn't leave a stale change behind
+    const uint8_t toOutput[] = {REG_CONFIG0, 0xfe, 0xff};
+    i2cWrite(d, toOutput, sizeof(toOutput));
+    mock_drive_pin(ioPins[d][1], 1);
+    mock_drive_pin(ioPins[d][1], 0);
+    if (mock_pin_mode(intPins[d]) == OUTPUT_LOW) {
+      fprintf(stderr, "device %d: nINT stuck after a direction change\n", d);
+      return 1;
+    }
+    const uint8_t toInput[] = {REG_CONFIG0, 0xff, 0xff};
+    i2cWrite(d, toInput, sizeof(toInput));
+  }
+  return 0;
+}
+
+
+int main(int argc, char **argv) {
+  uint64_t ops = 1000000;
+  if (argc > 1) {
+    ops = strtoull(argv[1], NULL, 10);
+  }
+
+  mock_reset_counters();
+  chip_init();
+  printf("chip_init: %llu host calls for %d devices\n",
+         (unsigned long long)mock_host_calls_total(), NUM_DEVICES);
+
+  char name[12];
+  for (int d=0; d<NUM_DEVICES; d++) {
+    devs[d] = mock_i2c_device(BASE_ADDRESS + d);
+    if (! devs[d]) {
+      fprintf(stderr, "bank did not register 0x%02x\n", BASE_ADDRESS + d);
+      return 1;
+    }
+    snprintf(name, sizeof(name), "D%d_nINT", d);
+    intPins[d] = mock_pin_by_name(name);
+    for (int i=0; i<16; i++) {
+      snprintf(name, sizeof(name), "D%d_P%d%d", d, i / 8, i % 8);
+      ioPins[d][i] = mock_pin_by_name(name);
+    }
+  }
+
+  if (checkInterrupts()) {
+    return 1;
+  }
+
+  // port 0 low nibble and port 1 high nibble as inputs, the rest outputs
+  const uint8_t cfg[] = {REG_CONFIG0, 0x0f, 0xf0};
+  for (int d=0; d<NUM_DEVICES; d++) {
+    i2cWrite(d, cfg, sizeof(cfg));
+  }
+
+  printf("%-36s %12s %10s %14s\n", "scenario", "ops", "ns/op", "host calls/op");
+  for (size_t s=0; s<sizeof(scenarios)/sizeof(scenarios[0]); s++) {
+    const scenario_t *sc = &scenarios[s];
+
+    mock_reset_counters();
+    uint64_t start = wallNs();
+    for (uint64_t i=0; i<ops; i++) {
+      sc->run(i);
+      mock_advance_ns(SIM_NS_PER_OP);
+    }
+    uint64_t elapsed = wallNs() - start;
+
+    printf("%-36s %12llu %10.1f %14.2f\n", sc->name,
+           (unsigned long long)ops,
+           (double)elapsed / ops,
+           (double)mock_host_calls_total() / ops);
+  }
+
+  return 0;
+}
@@ -0,0 +1,269 @@
+// Native benchmark for the pca9535 chip callbacks.
+// Builds src/pca9535.chip.c against mock_wokwi.c and drives
+// synthetic i2c transactions and pin edges through it, reporting
+// wall-clock ns/op and simulator host calls/op for each scenario.
+//
+//   make bench            (or: make bench BENCH_OPS=10000000)
+//
+// SPDX-License-Identifier: MIT
+
+#include "mock_wokwi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define CHIP_ADDRESS  0x20
+
+#define REG_INPUT0     0
+#define REG_OUTPUT0    2
+#define REG_CONFIG0    6
+#define REG_KP_CTRL      0x10
+#define REG_KP_ROWS0     0x11
+#define REG_KP_COLS0     0x13
+#define REG_PWM_ENABLE0  0x80
+#define REG_PWM_DUTY0    0x90
+
+// simulated time between operations, so coalescing and
+// flush timers behave as they would in a real run
+#define SIM_NS_PER_OP  1000
+
+static const i2c_config_t *dev;
+static pin_t ioPins[16];
+
+
+static uint64_t wallNs(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void i2cWrite(const uint8_t *bytes, int count) {
+  dev->connect(dev->user_data, CHIP_ADDRESS, false);
+  for (int i=0; i<count; i++) {
+    dev->write(dev->user_data, bytes[i]);
+  }
+  dev->disconnect(dev->user_data);
+}
+
+static uint16_t i2cRead(uint8_t reg) {
+  // command byte, then repeated start read of both ports
+  dev->connect(dev->user_data, CHIP_ADDRESS, false);
+  dev->write(dev->user_data, reg);
+  dev->connect(dev->user_data, CHIP_ADDRESS, true);
+  uint16_t value = dev->read(dev->user_data);
+  value |= (uint16_t)dev->read(dev->user_data) << 8;
+  dev->disconnect(dev->user_data);
+  return value;
+}
+
+
+typedef void (*scenario_fn_t)(uint64_t iteration);
+
+static void scenarioReadInputs(uint64_t i) {
+  (void)i2cRead(REG_INPUT0);
+}
+
+static void scenarioRewriteSameConfig(uint64_t i) {
+  const uint8_t cfg[] = {REG_CONFIG0, 0x0f, 0xf0};
+  i2cWrite(cfg, sizeof(cfg));
+}
+
+static void scenarioToggleConfigBit(uint64_t i) {
+  const uint8_t cfg[] = {REG_CONFIG0, (i & 1) ? 0x0e : 0x0f, 0xf0};
+  i2cWrite(cfg, sizeof(cfg));
+}
+
+static void scenarioToggleOutputBit(uint64_t i) {
+  const uint8_t out[] = {REG_OUTPUT0, (i & 1) ? 0xfe : 0xff, 0xff};
+  i2cWrite(out, sizeof(out));
+}
+
+static void scenarioBurstWrite(uint64_t i) {
+  // 16 bytes, cycling over the config pair
+  uint8_t burst[17];
+  burst[0] = REG_CONFIG0;
+  for (int b=1; b<17; b++) {
+    burst[b] = (b & 1) ? 0x0f : 0xf0;
+  }
+  i2cWrite(burst, sizeof(burst));
+}
+
+static void scenarioSingleEdge(uint64_t i) {
+  mock_drive_pin(ioPins[15], i & 1);
+}
+
+static void scenarioEdgeBurst(uint64_t i) {
+  // a whole input port changing at the same instant
+  for (int b=8; b<16; b++) {
+    mock_drive_pin(ioPins[b], i & 1);
+  }
+}
+
+static void scenarioEdgeThenRead(uint64_t i) {
+  mock_drive_pin(ioPins[15], i & 1);
+  (void)i2cRead(REG_INPUT0);
+}
+
+
+typedef struct {
+  const char *name;
+  scenario_fn_t run;
+  int opsDivisor;
+} scenario_t;
+
+static const scenario_t scenarios[] = {
+  {"read both inputs (cmd + 2 bytes)", scenarioReadInputs, 1},
+  {"rewrite same config", scenarioRewriteSameConfig, 1},
+  {"toggle one config bit", scenarioToggleConfigBit, 1},
+  {"toggle one output bit", scenarioToggleOutputBit, 1},
+  {"16 byte config burst", scenarioBurstWrite, 4},
+  {"single input edge", scenarioSingleEdge, 1},
+  {"8 simultaneous edges", scenarioEdgeBurst, 4},
+  {"edge then read", scenarioEdgeThenRead, 1},
+};
+
+/*
+  A PWM pin switched to input in its low phase is released, even
+  where input and output HIGH are the same pin mode (PCA9555).
+  Built as its own instance, the benchmark chip shadows it after.
+*/
+static int checkPwmRelease(void) {
+  mock_set_string_attr("variant", "pca9555");
+  chip_init();
+  dev = mock_i2c_device(CHIP_ADDRESS);
+  pin_t pin = mock_pin_by_name("P00");
+
+  const uint8_t cfgOut[] = {REG_CONFIG0, 0xfe, 0xff};
+  const uint8_t duty[] = {REG_PWM_DUTY0, 128};
+  const uint8_t enable[] = {REG_PWM_ENABLE0, 0x01};
+  i2cWrite(cfgOut, sizeof(cfgOut));
+  i2cWrite(duty, sizeof(duty));
+  i2cWrite(enable, sizeof(enable));
+
+  // past the falling edge of the default 1 ms period
+  mock_advance_ns(600000);
+  if (mock_pin_mode(pin) != OUTPUT_LOW) {
+    fprintf(stderr, "PWM pin not low in its low phase\n");
+    return 1;
+  }
+
+  const uint8_t cfgIn[] = {REG_CONFIG0, 0xff, 0xff};
+  i2cWrite(cfgIn, sizeof(cfgIn));
+  if (mock_pin_mode(pin) == OUTPUT_LOW) {
+    fprintf(stderr, "PWM pin still driven low after becoming an input\n");
+    return 1;
+  }
+
+  const uint8_t disable[] = {REG_PWM_ENABLE0, 0x00};
+  i2cWrite(disable, sizeof(disable));
+  mock_set_string_attr("variant", "pca9535");
+  return 0;
+}
+
+/*
+  The key scan takes its pins from the PWM schedule while it runs
+  and hands them back when it stops.
+*/
+static int checkPwmKeypad(void) {
+  mock_set_string_attr("variant", "pca9555");
+  chip_init();
+  dev = mock_i2c_device(CHIP_ADDRESS);
+  pin_t row = mock_pin_by_name("P00");
+  pin_t col = mock_pin_by_name("P01");
+
+  const uint8_t cfgOut[] = {REG_CONFIG0, 0xfc, 0xff};
+  const uint8_t duty[] = {REG_PWM_DUTY0, 128, 128};
+  const uint8_t enable[] = {REG_PWM_ENABLE0, 0x03};
+  i2cWrite(cfgOut, sizeof(cfgOut));
+  i2cWrite(duty, sizeof(duty));
+  i2cWrite(enable, sizeof(enable));
+
+  const uint8_t lines[] = {REG_KP_ROWS0, 0x01, 0x00, 0x02};
+  const uint8_t scanOn[] = {REG_KP_CTRL, 0x01};
+  i2cWrite(lines, sizeof(lines));
+  i2cWrite(scanOn, sizeof(scanOn));
+
+  mock_reset_counters();
+  mock_advance_ns(2000000);
+  if (mock_host_calls[HOST_PIN_MODE] || mock_pin_mode(row) != OUTPUT_LOW || mock_pin_mode(col) != INPUT_PULLUP) {
+    fprintf(stderr, "PWM still drives the key scan pins\n");
+    return 1;
+  }
+
+  // the period restarts high, low from half way
+  const uint8_t scanOff[] = {REG_KP_CTRL, 0x00};
+  i2cWrite(scanOff, sizeof(scanOff));
+  mock_advance_ns(750000);
+  if (mock_pin_mode(row) != OUTPUT_LOW || mock_pin_mode(col) != OUTPUT_LOW) {
+    fprintf(stderr, "PWM did not take the key scan pins back\n");
+    return 1;
+  }
+
+  const uint8_t disable[] = {REG_PWM_ENABLE0, 0x00};
+  i2cWrite(disable, sizeof(disable));
+  mock_set_string_attr("variant", "pca9535");
+  return 0;
+}
+
+
+int main(int argc, char **argv) {
+  uint64_t ops = 1000000;
+  if (argc > 1) {
+    ops = strtoull(argv[1], NULL, 10);
+  }
+
+  // as declared in pca9535.chip.json
+  mock_set_framebuffer_size(48, 102);
+  if (checkPwmRelease() || checkPwmKeypad()) {
+    return 1;
+  }
+  chip_init();
+
+  dev = mock_i2c_device(CHIP_ADDRESS);
+  if (! dev) {
+    fprintf(stderr, "chip did not register at 0x%02x\n", CHIP_ADDRESS);
+    return 1;
+  }
+
+  const char *ioPinNames[] = {
+        "P00", "P01", "P02", "P03", "P04", "P05", "P06", "P07",
+        "P10", "P11", "P12", "P13", "P14", "P15", "P16", "P17"};
+  for (int i=0; i<16; i++) {
+    ioPins[i] = mock_pin_by_name(ioPinNames[i]);
+  }
+
+  // port 0 low nibble and port 1 high nibble as inputs, the rest outputs
+  const uint8_t cfg[] = {REG_CONFIG0, 0x0f, 0xf0};
+  i2cWrite(cfg, sizeof(cfg));
+  mock_advance_ns(100000000);
+
+  printf("%-36s %12s %10s %14s\n", "scenario", "ops", "ns/op", "host calls/op");
+  for (size_t s=0; s<sizeof(scenarios)/sizeof(scenarios[0]); s++) {
+    const scenario_t *sc = &scenarios[s];
+    uint64_t n = ops / sc->opsDivisor;
+
+    mock_reset_counters();
+    uint64_t start = wallNs();
+    for (uint64_t i=0; i<n; i++) {
+      sc->run(i);
+      mock_advance_ns(SIM_NS_PER_OP);
+    }
+    uint64_t elapsed = wallNs() - start;
+
+    printf("%-36s %12llu %10.1f %14.2f\n", sc->name,
+           (unsigned long long)n,
+           (double)elapsed / n,
+           (double)mock_host_calls_total() / n);
+    // raw counts, in the ops column: rare calls would round to 0.00/op
+    for (int c=0; c<HOST_NUM_CALLS; c++) {
+      if (mock_host_calls[c]) {
+        printf("    %-32s %12llu\n", mock_host_call_names[c], (unsigned long long)mock_host_calls[c]);
+      }
+    }
+  }
+
+  // let any pending log/trace flush timers run
+  mock_advance_ns(1000000000);
+
+  return 0;
+}
@@ -0,0 +1,465 @@
+// Native stand-in for the Wokwi simulator imports declared in
+// wokwi-api.h.  Pins, watches, timers and i2c registrations are
+// kept in flat tables, and each import bumps a counter.
+//
+// SPDX-License-Identifier: MIT
+
+#include "mock_wokwi.h"
+#include <stdio.h>
+#include <string.h>
+
+uint64_t mock_host_calls[HOST_NUM_CALLS];
+
+const char * const mock_host_call_names[HOST_NUM_CALLS] = {
+  [HOST_PIN_INIT] = "pin_init",
+  [HOST_PIN_READ] = "pin_read",
+  [HOST_PIN_WRITE] = "pin_write",
+  [HOST_PIN_WATCH] = "pin_watch",
+  [HOST_PIN_WATCH_STOP] = "pin_watch_stop",
+  [HOST_PIN_MODE] = "pin_mode",
+  [HOST_I2C_INIT] = "i2c_init",
+  [HOST_TIMER_INIT] = "timer_init",
+  [HOST_TIMER_START] = "timer_start",
+  [HOST_TIMER_STOP] = "timer_stop",
+  [HOST_SIM_NANOS] = "get_sim_nanos",
+  [HOST_ATTR] = "attr_*",
+  [HOST_BUFFER] = "buffer_*",
+  [HOST_OTHER] = "other",
+};
+
+#define MOCK_PIN_NAME_LEN  16
+
+typedef struct {
+  char name[MOCK_PIN_NAME_LEN];  // copied, the chip may build names on the stack
+  uint32_t mode;
+  uint32_t level;
+  bool driven;        // externally driven, by mock_drive_pin
+  uint32_t drivenLevel;
+  bool watched;
+  pin_watch_config_t watch;
+} mock_pin_t;
+
+typedef struct {
+  timer_config_t config;
+  bool active;
+  bool repeat;
+  uint64_t due;
+  uint64_t period;
+} mock_timer_t;
+
+typedef struct {
+  const char *name;
+  float value;
+  const char *stringValue;
+} mock_attr_t;
+
+static mock_pin_t pins[MOCK_MAX_PINS];
+static uint32_t numPins;
+
+static mock_timer_t timers[MOCK_MAX_TIMERS];
+static uint32_t numTimers;
+
+static i2c_config_t i2cDevices[MOCK_MAX_I2C];
+static uint32_t numI2cDevices;
+
+static mock_attr_t attrs[MOCK_MAX_ATTRS];
+static uint32_t numAttrs;
+
+static uint64_t nowNs;
+
+static uint32_t framebufferWidth;
+static uint32_t framebufferHeight;
+
+
+void mock_reset_counters(void) {
+  memset(mock_host_calls, 0, sizeof(mock_host_calls));
+}
+
+uint64_t mock_host_calls_total(void) {
+  uint64_t total = 0;
+  for (int i=0; i<HOST_NUM_CALLS; i++) {
+    total += mock_host_calls[i];
+  }
+  return total;
+}
+
+static bool validPin(pin_t pin) {
+  return pin >= 0 && (uint32_t)pin < numPins;
+}
+
+/*
+  Resolve what a pin actually sits at, given its mode and
+  whatever is driving it from outside.
+*/
+static uint32_t resolveLevel(const mock_pin_t *p) {
+  switch (p->mode) {
+    case OUTPUT_LOW:
+      return LOW;
+    case OUTPUT_HIGH:
+      return HIGH;
+    case OUTPUT:
+      return p->level;
+    default:
+      break;
+  }
+  if (p->driven) {
+    return p->drivenLevel;
+  }
+  return (p->mode == INPUT_PULLUP) ? HIGH : LOW;
+}
+
+/*
+  Recompute a pin's level, firing its watch if the level
+  changed in a direction it cares about.
+*/
+static void settlePin(pin_t pin) {
+  mock_pin_t *p = &pins[pin];
+  uint32_t newLevel = resolveLevel(p);
+  if (newLevel == p->level) {
+    return;
+  }
+  p->level = newLevel;
+
+  if (p->watched) {
+    uint32_t edge = newLevel ? RISING : FALLING;
+    if (p->watch.edge & edge) {
+      p->watch.pin_change(p->watch.user_data, pin, newLevel);
+    }
+  }
+}
+
+
+pin_t mock_pin_by_name(const char *name) {
+  // latest first, a later instance shadows earlier ones
+  for (uint32_t i=numPins; i-- > 0; ) {
+    if (strcmp(pins[i].name, name) == 0) {
+      return (pin_t)i;
+    }
+  }
+  return NO_PIN;
+}
+
+void mock_drive_pin(pin_t pin, uint32_t value) {
+  if (! validPin(pin)) {
+    return;
+  }
+  pins[pin].driven = true;
+  pins[pin].drivenLevel = value ? HIGH : LOW;
+  settlePin(pin);
+}
+
+void mock_release_pin(pin_t pin) {
+  if (! validPin(pin)) {
+    return;
+  }
+  pins[pin].driven = false;
+  settlePin(pin);
+}
+
+uint32_t mock_pin_level(pin_t pin) {
+  return validPin(pin) ? pins[pin].level : LOW;
+}
+
+uint32_t mock_pin_mode(pin_t pin) {
+  return validPin(pin) ? pins[pin].mode : INPUT;
+}
+
+static mock_attr_t * findAttr(const char *name, bool create) {
+  for (uint32_t i=0; i<numAttrs; i++) {
+    if (strcmp(attrs[i].name, name) == 0) {
+      return &attrs[i];
+    }
+  }
+  if (! create || numAttrs >= MOCK_MAX_ATTRS) {
+    return NULL;
+  }
+  mock_attr_t *a = &attrs[numAttrs++];
+  a->name = name;
+  a->value = 0;
+  a->stringValue = NULL;
+  return a;
+}
+
+void mock_set_attr(const char *name, float value) {
+  mock_attr_t *a = findAttr(name, true);
+  if (a) {
+    a->value = value;
+  }
+}
+
+void mock_set_string_attr(const char *name, const char *value) {
+  mock_attr_t *a = findAttr(name, true);
+  if (a) {
+    a->stringValue = value;
+  }
+}
+
+const i2c_config_t * mock_i2c_device(uint32_t address) {
+  for (uint32_t i=numI2cDevices; i-- > 0; ) {
+    if (i2cDevices[i].address == address) {
+      return &i2cDevices[i];
+    }
+  }
+  return NULL;
+}
+
+void mock_set_framebuffer_size(uint32_t width, uint32_t height) {
+  framebufferWidth = width;
+  framebufferHeight = height;
+}
+
+uint64_t mock_now_ns(void) {
+  return nowNs;
+}
+
+void mock_advance_ns(uint64_t ns) {
+  uint64_t target = nowNs + ns;
+
+  for (;;) {
+    mock_timer_t *next = NULL;
+    for (uint32_t i=0; i<numTimers; i++) {
+      mock_timer_t *t = &timers[i];
+      if (t->active && t->due <= target && (! next || t->due < next->due)) {
+        next = t;
+      }
+    }
+    if (! next) {
+      break;
+    }
+
+    nowNs = next->due;
+    if (next->repeat && next->period) {
+      next->due += next->period;
+    } else {
+      next->active = false;
+    }
+    next->config.callback(next->config.user_data);
+  }
+
+  nowNs = target;
+}
+
+
+/* The imports themselves */
+
+pin_t pin_init(const char *name, uint32_t mode) {
+  mock_host_calls[HOST_PIN_INIT]++;
+  if (numPins >= MOCK_MAX_PINS) {
+    return NO_PIN;
+  }
+  pin_t pin = (pin_t)numPins++;
+  mock_pin_t *p = &pins[pin];
+  memset(p, 0, sizeof(*p));
+  strncpy(p->name, name, MOCK_PIN_NAME_LEN - 1);
+  p->mode = mode;
+  p->level = resolveLevel(p);
+  return pin;
+}
+
+uint32_t pin_read(pin_t pin) {
+  mock_host_calls[HOST_PIN_READ]++;
+  return mock_pin_level(pin);
+}
+
+void pin_write(pin_t pin, uint32_t value) {
+  mock_host_calls[HOST_PIN_WRITE]++;
+  if (! validPin(pin)) {
+    return;
+  }
+  pins[pin].level = value ? HIGH : LOW;
+}
+
+bool pin_watch(pin_t pin, const pin_watch_config_t *config) {
+  mock_host_calls[HOST_PIN_WATCH]++;
+  if (! validPin(pin) || pins[pin].watched) {
+    return false;
+  }
+  pins[pin].watched = true;
+  pins[pin].watch = *config;
+  return true;
+}
+
+void pin_watch_stop(pin_t pin) {
+  mock_host_calls[HOST_PIN_WATCH_STOP]++;
+  if (validPin(pin)) {
+    pins[pin].watched = false;
+  }
+}
+
+void pin_mode(pin_t pin, uint32_t value) {
+  mock_host_calls[HOST_PIN_MODE]++;
+  if (! validPin(pin)) {
+    return;
+  }
+  pins[pin].mode = value;
+  settlePin(pin);
+}
+
+float pin_adc_read(pin_t pin) {
+  mock_host_calls[HOST_OTHER]++;
+  return mock_pin_level(pin) ? 5.0f : 0.0f;
+}
+
+float pin_dac_write(pin_t pin, float voltage) {
+  mock_host_calls[HOST_OTHER]++;
+  return voltage;
+}
+
+uint32_t string_get_length(string_t string) {
+  mock_host_calls[HOST_ATTR]++;
+  if (string == STRING_NULL || string > numAttrs || ! attrs[string - 1].stringValue) {
+    return 0;
+  }
+  return strlen(attrs[string - 1].stringValue);
+}
+
+uint32_t string_read(string_t string, char *buf, uint32_t buffer_size) {
+  mock_host_calls[HOST_ATTR]++;
+  if (! buffer_size) {
+    return 0;
+  }
+  buf[0] = '\0';
+  if (string == STRING_NULL || string > numAttrs || ! attrs[string - 1].stringValue) {
+    return 0;
+  }
+  strncpy(buf, attrs[string - 1].stringValue, buffer_size - 1);
+  buf[buffer_size - 1] = '\0';
+  return strlen(buf);
+}
+
+/*
+  Attribute ids are 1-based slots in the attrs table,
+  created with their default if the harness didn't set them.
+*/
+static uint32_t attrId(const char *name, float default_value) {
+  mock_attr_t *a = findAttr(name, false);
+  if (! a) {
+    a = findAttr(name, true);
+    if (! a) {
+      return 0;
+    }
+    a->value = default_value;
+  }
+  return (uint32_t)(a - attrs) + 1;
+}
+
+uint32_t attr_init(const char *name, uint32_t default_value) {
+  mock_host_calls[HOST_ATTR]++;
+  return attrId(name, (float)default_value);
+}
+
+uint32_t attr_init_float(const char *name, float default_value) {
+  mock_host_calls[HOST_ATTR]++;
+  return attrId(name, default_value);
+}
+
+uint32_t attr_read(uint32_t attr_id) {
+  mock_host_calls[HOST_ATTR]++;
+  if (! attr_id || attr_id > numAttrs) {
+    return 0;
+  }
+  return (uint32_t)attrs[attr_id - 1].value;
+}
+
+float attr_read_float(uint32_t attr_id) {
+  mock_host_calls[HOST_ATTR]++;
+  if (! attr_id || attr_id > numAttrs) {
+    return 0;
+  }
+  return attrs[attr_id - 1].value;
+}
+
+string_t attr_string_init(const char *name) {
+  mock_host_calls[HOST_ATTR]++;
+  mock_attr_t *a = findAttr(name, false);
+  if (! a || ! a->stringValue) {
+    return STRING_NULL;
+  }
+  return (string_t)(a - attrs) + 1;
+}
+
+i2c_dev_t i2c_init(const i2c_config_t *config) {
+  mock_host_calls[HOST_I2C_INIT]++;
+  if (numI2cDevices >= MOCK_MAX_I2C) {
+    return 0;
+  }
+  i2cDevices[numI2cDevices] = *config;
+  return ++numI2cDevices;
+}
+
+uart_dev_t uart_init(const uart_config_t *config) {
+  mock_host_calls[HOST_OTHER]++;
+  return 0;
+}
+
+bool uart_write(uart_dev_t uart, uint8_t *buffer, uint32_t count) {
+  mock_host_calls[HOST_OTHER]++;
+  return false;
+}
+
+spi_dev_t spi_init(const spi_config_t *spi_config) {
+  mock_host_calls[HOST_OTHER]++;
+  return 0;
+}
+
+void spi_start(const spi_dev_t spi, uint8_t *buffer, uint32_t count) {
+  mock_host_calls[HOST_OTHER]++;
+}
+
+void spi_stop(const spi_dev_t spi) {
+  mock_host_calls[HOST_OTHER]++;
+}
+
+timer_t timer_init(const timer_config_t *config) {
+  mock_host_calls[HOST_TIMER_INIT]++;
+  if (numTimers >= MOCK_MAX_TIMERS) {
+    return 0;
+  }
+  memset(&timers[numTimers], 0, sizeof(mock_timer_t));
+  timers[numTimers].config = *config;
+  return numTimers++;
+}
+
+void timer_start_ns_d(const timer_t timer, double nanos, bool repeat) {
+  mock_host_calls[HOST_TIMER_START]++;
+  if (timer >= numTimers) {
+    return;
+  }
+  mock_timer_t *t = &timers[timer];
+  t->period = (uint64_t)nanos;
+  t->due = nowNs + t->period;
+  t->repeat = repeat;
+  t->active = true;
+}
+
+void timer_start(const timer_t timer, uint32_t micros, bool repeat) {
+  timer_start_ns_d(timer, (double)micros * 1000.0, repeat);
+}
+
+void timer_stop(const timer_t timer) {
+  mock_host_calls[HOST_TIMER_STOP]++;
+  if (timer < numTimers) {
+    timers[timer].active = false;
+  }
+}
+
+double get_sim_nanos_d(void) {
+  mock_host_calls[HOST_SIM_NANOS]++;
+  return (double)nowNs;
+}
+
+buffer_t framebuffer_init(uint32_t *pixel_width, uint32_t *pixel_height) {
+  mock_host_calls[HOST_BUFFER]++;
+  *pixel_width = framebufferWidth;
+  *pixel_height = framebufferHeight;
+  return 1;
+}
+
+void buffer_read(buffer_t buffer, uint32_t offset, uint8_t *data, uint8_t data_len) {
+  mock_host_calls[HOST_BUFFER]++;
+  memset(data, 0, data_len);
+}
+
+void buffer_write(buffer_t buffer, uint32_t offset, uint8_t *data, uint8_t data_len) {
+  mock_host_calls[HOST_BUFFER]++;
+}
@@ -0,0 +1,66 @@
+// Native stand-in for the Wokwi simulator, so the chip can be
+// built and driven on the host (see bench.c).
+//
+// SPDX-License-Identifier: MIT
+
+#ifndef MOCK_WOKWI_H
+#define MOCK_WOKWI_H
+
+#include "wokwi-api.h"
+
+#define MOCK_MAX_PINS    160
+#define MOCK_MAX_TIMERS  32
+#define MOCK_MAX_I2C     16
+#define MOCK_MAX_ATTRS   32
+
+/*
+  Every import the chip can call, counted so the
+  harness can report host calls/op.
+*/
+typedef enum {
+  HOST_PIN_INIT = 0,
+  HOST_PIN_READ,
+  HOST_PIN_WRITE,
+  HOST_PIN_WATCH,
+  HOST_PIN_WATCH_STOP,
+  HOST_PIN_MODE,
+  HOST_I2C_INIT,
+  HOST_TIMER_INIT,
+  HOST_TIMER_START,
+  HOST_TIMER_STOP,
+  HOST_SIM_NANOS,
+  HOST_ATTR,
+  HOST_BUFFER,
+  HOST_OTHER,
+  HOST_NUM_CALLS
+} mock_host_call_t;
+
+extern uint64_t mock_host_calls[HOST_NUM_CALLS];
+extern const char * const mock_host_call_names[HOST_NUM_CALLS];
+
+void mock_reset_counters(void);
+uint64_t mock_host_calls_total(void);
+
+// pins, as seen from "outside" the chip (by name, the most
+// recently created pin wins when several chips are built)
+pin_t mock_pin_by_name(const char *name);
+void mock_drive_pin(pin_t pin, uint32_t value);
+void mock_release_pin(pin_t pin);
+uint32_t mock_pin_level(pin_t pin);
+uint32_t mock_pin_mode(pin_t pin);
+
+// attributes are looked up by name when the chip calls attr_init*
+void mock_set_attr(const char *name, float value);
+void mock_set_string_attr(const char *name, const char *value);
+
+// what framebuffer_init reports, i.e. the chip.json display (0x0: none)
+void mock_set_framebuffer_size(uint32_t width, uint32_t height);
+
+// i2c devices registered by the chip, by 7-bit address (latest first)
+const i2c_config_t * mock_i2c_device(uint32_t address);
+
+// simulated time, advancing it fires any timers that come due
+uint64_t mock_now_ns(void);
+void mock_advance_ns(uint64_t ns);
+
+#endif /* MOCK_WOKWI_H */
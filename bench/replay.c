@@ -0,0 +1,289 @@
+// Replay a recorded event trace (see src/pca9535-trace.h) against
+// the chip, natively.  Pin edges and i2c traffic from the recording
+// are fed into the chip callbacks at their original sim timestamps,
+// and what the chip does in response (direction and output changes,
+// nINT transitions, bytes returned on reads, key events) is checked
+// against what was recorded.
+//
+//   make replay
+//   dist/replay [-a name=value]... [-t ns] < simulation.log
+//
+// -a sets a chip attribute, as the recording's diagram did, and
+// -t allows that much timestamp slack when comparing.  The exit
+// status is non-zero if the chip behaved differently.  Only chip
+// instance 0 of the recording is replayed.
+//
+// Built with -DCHIP_TRACE=1 -DCHIP_TRACE_SINK=replay_trace_sink, so
+// the chip's own trace of the replay comes straight back here.
+//
+// SPDX-License-Identifier: MIT
+
+#include "mock_wokwi.h"
+#include "trace-log.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NUM_GPIO       16
+#define MAX_REPORTED   10
+
+void pca9535_trace_flush(void);
+
+/*
+  What the chip did, with its absolute sim time.  Both the
+  recording and the replay are reduced to these.
+*/
+typedef struct {
+  uint64_t time;
+  uint8_t type;
+  uint16_t value;
+} observation_t;
+
+typedef struct {
+  observation_t *items;
+  size_t count;
+  size_t capacity;
+  // running state while collecting
+  uint64_t now;
+  int lastInt;
+} observations_t;
+
+static observations_t expected;
+static observations_t actual;
+
+static pin_t ioPins[NUM_GPIO];
+
+
+static uint64_t wallNs(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void observationsInit(observations_t *obs) {
+  memset(obs, 0, sizeof(*obs));
+  obs->lastInt = -1;
+}
+
+/*
+  Keep the records that are the chip's response, rather than
+  its stimulus.  nINT is reduced to its transitions: how often
+  the chip re-drives the same level is not behaviour.
+*/
+static void observe(observations_t *obs, const trace_record_t *rec) {
+  obs->now += rec->delta;
+  if (traceChip(rec) != 0) {
+    return;
+  }
+
+  switch (rec->type) {
+    case TRACE_EV_INT:
+      if (obs->lastInt == rec->value) {
+        return;
+      }
+      obs->lastInt = rec->value;
+      break;
+    case TRACE_EV_DIRECTION:
+    case TRACE_EV_OUTPUT:
+    case TRACE_EV_I2C_READ:
+    case TRACE_EV_KEY:
+      break;
+    default:
+      return;
+  }
+
+  if (obs->count == obs->capacity) {
+    obs->capacity = obs->capacity ? obs->capacity * 2 : 4096;
+    obs->items = realloc(obs->items, obs->capacity * sizeof(observation_t));
+    if (! obs->items) {
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+    }
+  }
+  observation_t *o = &obs->items[obs->count++];
+  o->time = obs->now;
+  o->type = rec->type;
+  o->value = rec->value;
+}
+
+void replay_trace_sink(const trace_record_t *records, uint32_t count) {
+  for (uint32_t i=0; i<count; i++) {
+    observe(&actual, &records[i]);
+  }
+}
+
+static const char * eventName(uint8_t type) {
+  switch (type) {
+    case TRACE_EV_DIRECTION: return "direction";
+    case TRACE_EV_OUTPUT: return "output";
+    case TRACE_EV_INT: return "nINT";
+    case TRACE_EV_I2C_READ: return "i2c read";
+    case TRACE_EV_KEY: return "key";
+    default: return "?";
+  }
+}
+
+static void printObservation(const char *label, const observations_t *obs, size_t i) {
+  if (i >= obs->count) {
+    printf("    %-9s (nothing)\n", label);
+    return;
+  }
+  const observation_t *o = &obs->items[i];
+  printf("    %-9s %14llu ns  %-9s 0x%04x\n", label, (unsigned long long)o->time, eventName(o->type), o->value);
+}
+
+static size_t compare(uint64_t slackNs) {
+  size_t mismatches = 0;
+  size_t n = expected.count > actual.count ? expected.count : actual.count;
+
+  for (size_t i=0; i<n; i++) {
+    bool same = false;
+    if (i < expected.count && i < actual.count) {
+      const observation_t *e = &expected.items[i];
+      const observation_t *a = &actual.items[i];
+      uint64_t dt = (e->time > a->time) ? e->time - a->time : a->time - e->time;
+      same = e->type == a->type && e->value == a->value && dt <= slackNs;
+    }
+    if (same) {
+      continue;
+    }
+    if (mismatches++ < MAX_REPORTED) {
+      printf("  mismatch at #%zu:\n", i);
+      printObservation("recorded", &expected, i);
+      printObservation("replayed", &actual, i);
+    }
+  }
+  return mismatches;
+}
+
+/*
+  Attributes: numbers go in as such, anything else as a string.
+*/
+static void setAttr(char *assignment) {
+  char *eq = strchr(assignment, '=');
+  if (! eq) {
+    fprintf(stderr, "-a expects name=value\n");
+    exit(2);
+  }
+  *eq = '\0';
+  char *end;
+  float value = strtof(eq + 1, &end);
+  if (*end == '\0' && end != eq + 1) {
+    mock_set_attr(assignment, value);
+  } else {
+    mock_set_string_attr(assignment, eq + 1);
+  }
+}
+
+
+int main(int argc, char **argv) {
+  trace_log_t log = {0};
+  uint64_t slackNs = 0;
+
+  for (int i=1; i<argc; i++) {
+    if (! strcmp(argv[i], "-a") && i + 1 < argc) {
+      setAttr(argv[++i]);
+    } else if (! strcmp(argv[i], "-t") && i + 1 < argc) {
+      slackNs = strtoull(argv[++i], NULL, 10);
+    } else {
+      fprintf(stderr, "usage: %s [-a name=value]... [-t ns] < simulation.log\n", argv[0]);
+      return 2;
+    }
+  }
+
+  traceLogRead(&log, stdin);
+  if (! log.count) {
+    fprintf(stderr, "no trace records found\n");
+    return 2;
+  }
+
+  observationsInit(&expected);
+  observationsInit(&actual);
+  for (size_t i=0; i<log.count; i++) {
+    observe(&expected, &log.records[i]);
+  }
+
+  uint64_t wallStart = wallNs();
+  chip_init();
+
+  const char *ioPinNames[] = {
+        "P00", "P01", "P02", "P03", "P04", "P05", "P06", "P07",
+        "P10", "P11", "P12", "P13", "P14", "P15", "P16", "P17"};
+  for (int i=0; i<NUM_GPIO; i++) {
+    ioPins[i] = mock_pin_by_name(ioPinNames[i]);
+  }
+
+  // the chip registered one device, whatever its address pins say
+  // (address 0 is the General Call)
+  const i2c_config_t *dev = NULL;
+  for (uint32_t addr=1; addr<128 && ! dev; addr++) {
+    dev = mock_i2c_device(addr);
+  }
+  if (! dev) {
+    fprintf(stderr, "chip did not register an i2c device\n");
+    return 2;
+  }
+
+  mock_reset_counters();
+
+  uint64_t now = 0;
+  size_t stimuli = 0;
+  size_t otherChips = 0;
+  for (size_t i=0; i<log.count; i++) {
+    const trace_record_t *rec = &log.records[i];
+    now += rec->delta;
+    if (traceChip(rec) != 0) {
+      otherChips++;
+      continue;
+    }
+    if (now > mock_now_ns()) {
+      mock_advance_ns(now - mock_now_ns());
+    }
+
+    switch (rec->type) {
+      case TRACE_EV_PIN_EDGE:
+        if (traceArg(rec) < NUM_GPIO) {
+          mock_drive_pin(ioPins[traceArg(rec)], rec->value);
+        }
+        break;
+      case TRACE_EV_I2C_CONNECT:
+        dev->connect(dev->user_data, rec->value, traceArg(rec));
+        break;
+      case TRACE_EV_I2C_WRITE:
+        dev->write(dev->user_data, (uint8_t)rec->value);
+        break;
+      case TRACE_EV_I2C_READ:
+        // what it returns is in the chip's own trace
+        (void)dev->read(dev->user_data);
+        break;
+      case TRACE_EV_I2C_DISCONNECT:
+        dev->disconnect(dev->user_data);
+        break;
+      default:
+        // the chip's side of things, that's what we check
+        continue;
+    }
+    stimuli++;
+  }
+
+  // the recording ends here, so does the comparison
+  pca9535_trace_flush();
+  uint64_t wallElapsed = wallNs() - wallStart;
+
+  printf("replayed %zu stimuli over %.3f s of sim time in %.3f s (%.0fx)\n",
+         stimuli, now / 1e9, wallElapsed / 1e9, wallElapsed ? (double)now / wallElapsed : 0.0);
+  printf("host calls: %llu (%.2f per stimulus)\n",
+         (unsigned long long)mock_host_calls_total(), stimuli ? (double)mock_host_calls_total() / stimuli : 0.0);
+  if (otherChips) {
+    printf("skipped %zu records from other chip instances\n", otherChips);
+  }
+
+  size_t mismatches = compare(slackNs);
+  printf("%zu observations recorded, %zu replayed, %zu mismatches\n",
+         expected.count, actual.count, mismatches);
+
+  traceLogFree(&log);
+  return mismatches ? 1 : 0;
+}
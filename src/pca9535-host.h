@@ -0,0 +1,451 @@
+// Console output, host call accounting and the deferred logger,
+// shared by the chips in src/.  These are definitions: include it
+// once, from the chip's own translation unit.
+//
+// SPDX-License-Identifier: GPL
+// Copyright 2023 Pat Deegan, https://psychogenic.com
+
+#ifndef PCA9535_HOST_H
+#define PCA9535_HOST_H
+
+#include "wokwi-api.h"
+#include <stdarg.h>
+#include <stddef.h>
+
+// Freestanding build (make release): no libc at all, console
+// output goes straight to WASI fd_write
+#ifndef CHIP_FREESTANDING
+#define CHIP_FREESTANDING 0
+#endif
+
+#if ! CHIP_FREESTANDING
+#include <stdio.h>
+#endif
+
+
+/* Console output
+  A tiny formatter (%d %i %u %x with optional 0-padded width, 
+  %s, %c, %%) so we never need the libc printf machinery.
+  Messages are formatted to a small buffer and written in one go.
+*/
+#define CHIP_PRINT_BUFSIZE  128
+
+#if CHIP_FREESTANDING
+
+typedef struct {
+  const uint8_t * buf;
+  uint32_t len;
+} wasi_ciovec_t;
+
+extern __attribute__((import_module("wasi_snapshot_preview1"), import_name("fd_write")))
+uint16_t wasi_fd_write(uint32_t fd, const wasi_ciovec_t * iovs, uint32_t iovs_len, uint32_t * nwritten);
+
+void chipWrite(const char * buf, uint32_t len) {
+  wasi_ciovec_t iov = { .buf = (const uint8_t *)buf, .len = len };
+  uint32_t written;
+  wasi_fd_write(1, &iov, 1, &written);
+}
+
+// the compiler may still emit calls to these for struct copies/init
+void * memset(void * dest, int c, size_t n) {
+  uint8_t * d = dest;
+  while (n--) {
+    *d++ = (uint8_t)c;
+  }
+  return dest;
+}
+
+void * memcpy(void * dest, const void * src, size_t n) {
+  uint8_t * d = dest;
+  const uint8_t * s = src;
+  while (n--) {
+    *d++ = *s++;
+  }
+  return dest;
+}
+
+#else
+
+void chipWrite(const char * buf, uint32_t len) {
+  fwrite(buf, 1, len, stdout);
+}
+
+#endif /* CHIP_FREESTANDING */
+
+uint32_t formatNumber(char * out, uint32_t value, uint8_t base, uint8_t width, char pad) {
+  char digits[10];
+  uint8_t n = 0;
+  do {
+    uint8_t d = value % base;
+    digits[n++] = (d < 10) ? ('0' + d) : ('a' + d - 10);
+    value /= base;
+  } while (value);
+
+  uint32_t len = 0;
+  while (width > n) {
+    out[len++] = pad;
+    width--;
+  }
+  while (n) {
+    out[len++] = digits[--n];
+  }
+  return len;
+}
+
+void chipPrintf(const char * fmt, ...) {
+  char buf[CHIP_PRINT_BUFSIZE];
+  uint32_t len = 0;
+  va_list args;
+  va_start(args, fmt);
+
+  // leave room for the longest single conversion
+  while (*fmt && len < CHIP_PRINT_BUFSIZE - 12) {
+    char c = *fmt++;
+    if (c != '%') {
+      buf[len++] = c;
+      continue;
+    }
+
+    char pad = ' ';
+    uint8_t width = 0;
+    if (*fmt == '0') {
+      pad = '0';
+      fmt++;
+    }
+    while (*fmt >= '0' && *fmt <= '9') {
+      width = width * 10 + (*fmt++ - '0');
+    }
+    if (width > 10) {
+      width = 10;
+    }
+
+    switch (*fmt++) {
+      case 'd':
+      case 'i': {
+        int value = va_arg(args, int);
+        uint32_t magnitude = (uint32_t)value;
+        if (value < 0) {
+          buf[len++] = '-';
+          magnitude = -magnitude;
+        }
+        len += formatNumber(&buf[len], magnitude, 10, width, pad);
+        break;
+      }
+      case 'u':
+        len += formatNumber(&buf[len], va_arg(args, unsigned), 10, width, pad);
+        break;
+      case 'x':
+        len += formatNumber(&buf[len], va_arg(args, unsigned), 16, width, pad);
+        break;
+      case 'c':
+        buf[len++] = (char)va_arg(args, int);
+        break;
+      case 's': {
+        const char * str = va_arg(args, const char *);
+        while (*str && len < CHIP_PRINT_BUFSIZE - 1) {
+          buf[len++] = *str++;
+        }
+        break;
+      }
+      case '%':
+        buf[len++] = '%';
+        break;
+      case '\0':
+        // dangling % at the end
+        fmt--;
+        break;
+      default:
+        break;
+    }
+  }
+
+  va_end(args);
+  chipWrite(buf, len);
+}
+
+
+/* Host call accounting
+  Crossing into the simulator is the expensive part of a chip,
+  so every pin and timer import goes through a host*() shim that 
+  counts it against whichever callback we're currently in.
+  Build with -DCHIP_HOST_STATS=0 to compile all of it out.
+*/
+#ifndef CHIP_HOST_STATS
+#define CHIP_HOST_STATS 1
+#endif
+
+typedef enum {
+  HOSTCTX_INIT = 0,
+  HOSTCTX_I2C_CONNECT,
+  HOSTCTX_I2C_READ,
+  HOSTCTX_I2C_WRITE,
+  HOSTCTX_I2C_DISCONNECT,
+  HOSTCTX_INPUT_CHANGE,
+  HOSTCTX_ADDR_CHANGE,
+  HOSTCTX_TIMER,
+  HOSTCTX_NUM_CONTEXTS
+} host_context_t;
+
+typedef enum {
+  HOSTCALL_PIN_INIT = 0,
+  HOSTCALL_PIN_READ,
+  HOSTCALL_PIN_MODE,
+  HOSTCALL_PIN_WATCH,
+  HOSTCALL_PIN_WATCH_STOP,
+  HOSTCALL_TIMER_INIT,
+  HOSTCALL_TIMER_START,
+  HOSTCALL_SIM_NANOS,
+  HOSTCALL_BUFFER_WRITE,
+  HOSTCALL_I2C_INIT,
+  HOSTCALL_OTHER,
+  // not a host call, how many times the callback itself ran
+  HOSTCALL_INVOCATIONS,
+  HOSTCALL_NUM_CALLS
+} host_call_t;
+
+#if CHIP_HOST_STATS
+
+static const char * const hostContextNames[HOSTCTX_NUM_CONTEXTS] = {
+  [HOSTCTX_INIT] = "init",
+  [HOSTCTX_I2C_CONNECT] = "on_i2c_connect",
+  [HOSTCTX_I2C_READ] = "on_i2c_read",
+  [HOSTCTX_I2C_WRITE] = "on_i2c_write",
+  [HOSTCTX_I2C_DISCONNECT] = "on_i2c_disconnect",
+  [HOSTCTX_INPUT_CHANGE] = "chip_input_io_change",
+  [HOSTCTX_ADDR_CHANGE] = "chip_addr_change",
+  [HOSTCTX_TIMER] = "timer",
+};
+
+static const char * const hostCallNames[HOSTCALL_NUM_CALLS] = {
+  [HOSTCALL_PIN_INIT] = "pin_init",
+  [HOSTCALL_PIN_READ] = "pin_read",
+  [HOSTCALL_PIN_MODE] = "pin_mode",
+  [HOSTCALL_PIN_WATCH] = "pin_watch",
+  [HOSTCALL_PIN_WATCH_STOP] = "pin_watch_stop",
+  [HOSTCALL_TIMER_INIT] = "timer_init",
+  [HOSTCALL_TIMER_START] = "timer_start",
+  [HOSTCALL_SIM_NANOS] = "get_sim_nanos",
+  [HOSTCALL_BUFFER_WRITE] = "buffer_write",
+  [HOSTCALL_I2C_INIT] = "i2c_init",
+  [HOSTCALL_OTHER] = "other",
+  [HOSTCALL_INVOCATIONS] = "invocations",
+};
+
+typedef struct {
+  uint32_t counts[HOSTCTX_NUM_CONTEXTS][HOSTCALL_NUM_CALLS];
+  uint8_t context;
+  timer_t dumpTimer;
+} host_stats_t;
+
+static host_stats_t hostStats;
+
+uint8_t hostContextEnter(uint8_t context) {
+  uint8_t previous = hostStats.context;
+  hostStats.context = context;
+  hostStats.counts[context][HOSTCALL_INVOCATIONS]++;
+  return previous;
+}
+
+void hostContextLeave(uint8_t * previous) {
+  hostStats.context = *previous;
+}
+
+/*
+  Callbacks can nest (a pin_mode can trigger a watch callback
+  synchronously), so the context is restored on scope exit.
+*/
+#define HOST_CONTEXT(ctx) \
+  uint8_t hostCtxSaved __attribute__((cleanup(hostContextLeave))) = hostContextEnter(ctx)
+#define HOST_COUNT(call)  hostStats.counts[hostStats.context][call]++
+
+void hostStatsPrint(void) {
+  chipPrintf("host calls per callback:\n");
+  for (uint8_t ctx=0; ctx<HOSTCTX_NUM_CONTEXTS; ctx++) {
+    const uint32_t * counts = hostStats.counts[ctx];
+    if (! counts[HOSTCALL_INVOCATIONS]) {
+      continue;
+    }
+    chipPrintf("  %s: %u calls\n", hostContextNames[ctx], (unsigned)counts[HOSTCALL_INVOCATIONS]);
+    for (uint8_t call=0; call<HOSTCALL_INVOCATIONS; call++) {
+      if (counts[call]) {
+        chipPrintf("    %s %u\n", hostCallNames[call], (unsigned)counts[call]);
+      }
+    }
+  }
+}
+
+#else
+
+#define HOST_CONTEXT(ctx)  do {} while (0)
+#define HOST_COUNT(call)   do {} while (0)
+
+void hostStatsPrint(void) {}
+
+#endif /* CHIP_HOST_STATS */
+
+pin_t hostPinInit(const char * name, uint32_t mode) {
+  HOST_COUNT(HOSTCALL_PIN_INIT);
+  return pin_init(name, mode);
+}
+
+uint32_t hostPinRead(pin_t pin) {
+  HOST_COUNT(HOSTCALL_PIN_READ);
+  return pin_read(pin);
+}
+
+void hostPinMode(pin_t pin, uint32_t mode) {
+  HOST_COUNT(HOSTCALL_PIN_MODE);
+  pin_mode(pin, mode);
+}
+
+bool hostPinWatch(pin_t pin, const pin_watch_config_t * config) {
+  HOST_COUNT(HOSTCALL_PIN_WATCH);
+  return pin_watch(pin, config);
+}
+
+void hostPinWatchStop(pin_t pin) {
+  HOST_COUNT(HOSTCALL_PIN_WATCH_STOP);
+  pin_watch_stop(pin);
+}
+
+timer_t hostTimerInit(const timer_config_t * config) {
+  HOST_COUNT(HOSTCALL_TIMER_INIT);
+  return timer_init(config);
+}
+
+void hostTimerStart(timer_t timer, uint32_t micros, bool repeat) {
+  HOST_COUNT(HOSTCALL_TIMER_START);
+  timer_start(timer, micros, repeat);
+}
+
+void hostTimerStartNs(timer_t timer, uint64_t nanos, bool repeat) {
+  HOST_COUNT(HOSTCALL_TIMER_START);
+  timer_start_ns(timer, nanos, repeat);
+}
+
+void hostTimerStop(timer_t timer) {
+  HOST_COUNT(HOSTCALL_OTHER);
+  timer_stop(timer);
+}
+
+void hostBufferWrite(buffer_t buffer, uint32_t offset, uint8_t * data, uint8_t len) {
+  HOST_COUNT(HOSTCALL_BUFFER_WRITE);
+  buffer_write(buffer, offset, data, len);
+}
+
+i2c_dev_t hostI2cInit(const i2c_config_t * config) {
+  HOST_COUNT(HOSTCALL_I2C_INIT);
+  return i2c_init(config);
+}
+
+uint64_t hostSimNanos(void) {
+  HOST_COUNT(HOSTCALL_SIM_NANOS);
+  return get_sim_nanos();
+}
+
+
+/* Logging
+  Log calls don't format anything, they just drop a small binary
+  record into a ring buffer.  Records are only turned into text,
+  with the chip's format table, when the buffer is flushed, from a timer armed by the first 
+  record to land in an empty buffer.
+  Anything above CHIP_LOG_LEVEL compiles out entirely, so the
+  hot path (per-edge, per-transaction) logs at DEBUG and costs
+  nothing in a normal build.  Build with e.g.
+    make LOG_LEVEL=4
+  to get those back.
+*/
+#define LOG_LEVEL_NONE   0
+#define LOG_LEVEL_ERROR  1
+#define LOG_LEVEL_WARN   2
+#define LOG_LEVEL_INFO   3
+#define LOG_LEVEL_DEBUG  4
+
+#ifndef CHIP_LOG_LEVEL
+#define CHIP_LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// must be a power of two
+#define LOG_RING_SIZE  64
+#define LOG_FLUSH_DELAY_US  10000
+
+typedef struct {
+  uint16_t event;
+  uint16_t arg[2];
+} log_record_t;
+
+typedef struct {
+  const char * const * formats;
+  log_record_t records[LOG_RING_SIZE];
+  uint32_t head;
+  uint32_t tail;
+  uint32_t dropped;
+  timer_t flushTimer;
+  bool flushTimerValid;
+} log_ring_t;
+
+static log_ring_t logRing;
+
+void logFlush(void) {
+  while (logRing.tail != logRing.head) {
+    const log_record_t * rec = &(logRing.records[logRing.tail & (LOG_RING_SIZE - 1)]);
+    chipPrintf(logRing.formats[rec->event], rec->arg[0], rec->arg[1]);
+    logRing.tail++;
+  }
+
+  if (logRing.dropped) {
+    chipPrintf("(%u log records dropped)\n", (unsigned)logRing.dropped);
+    logRing.dropped = 0;
+  }
+}
+
+void logFlushTimerCallback(void *user_data) {
+  HOST_CONTEXT(HOSTCTX_TIMER);
+  logFlush();
+}
+
+/*
+  formats: the chip's message table, one format per event.
+*/
+void logInit(const char * const * formats) {
+  const timer_config_t flushTimerConfig = {
+    .callback = logFlushTimerCallback,
+    .user_data = NULL,
+  };
+  logRing.formats = formats;
+  logRing.head = 0;
+  logRing.tail = 0;
+  logRing.dropped = 0;
+  logRing.flushTimer = hostTimerInit(&flushTimerConfig);
+  logRing.flushTimerValid = true;
+}
+
+void logRecord(uint16_t event, uint16_t arg0, uint16_t arg1) {
+  if (logRing.head - logRing.tail >= LOG_RING_SIZE) {
+    // full: the flush is already pending, just keep count
+    logRing.dropped++;
+    return;
+  }
+
+  if (logRing.head == logRing.tail && logRing.flushTimerValid) {
+    // first record in an empty ring, schedule a flush
+    hostTimerStart(logRing.flushTimer, LOG_FLUSH_DELAY_US, false);
+  }
+
+  log_record_t * rec = &(logRing.records[logRing.head & (LOG_RING_SIZE - 1)]);
+  rec->event = event;
+  rec->arg[0] = arg0;
+  rec->arg[1] = arg1;
+  logRing.head++;
+}
+
+#define LOG_AT(lvl, ev, a0, a1) do { \
+    if ((lvl) <= CHIP_LOG_LEVEL) { logRecord((ev), (a0), (a1)); } \
+  } while (0)
+
+#define LOG_ERROR(ev, a0, a1)  LOG_AT(LOG_LEVEL_ERROR, ev, a0, a1)
+#define LOG_WARN(ev, a0, a1)   LOG_AT(LOG_LEVEL_WARN, ev, a0, a1)
+#define LOG_INFO(ev, a0, a1)   LOG_AT(LOG_LEVEL_INFO, ev, a0, a1)
+#define LOG_DEBUG(ev, a0, a1)  LOG_AT(LOG_LEVEL_DEBUG, ev, a0, a1)
+
+#endif /* PCA9535_HOST_H */
@@ -0,0 +1,36 @@
+// PCA9535 register map, and how the Input Port reads back, shared
+// by pca9535.chip.c and pca9535bank.chip.c so both behave the same.
+//
+// SPDX-License-Identifier: GPL
+// Copyright 2023 Pat Deegan, https://psychogenic.com
+
+#ifndef PCA9535_REGS_H
+#define PCA9535_REGS_H
+
+#include <stdint.h>
+
+#define I2C_BASE_ADDRESS 0x20
+#define NUM_GPIO  16
+
+// the command byte selects one of these
+#define REG_INPUT0     0
+#define REG_INPUT1     1
+#define REG_OUTPUT0    2
+#define REG_OUTPUT1    3
+#define REG_POLARITY0  4
+#define REG_POLARITY1  5
+#define REG_CONFIG0    6
+#define REG_CONFIG1    7
+#define NUM_REGS       8
+
+/*
+  Input Port value: the Input Port shows pin levels whatever the
+  direction, so input pins read what they're driven to and output 
+  pins (1 in outputs = driven/released HIGH) what they drive.  The 
+  polarity register then inverts it bit for bit.
+*/
+static inline uint16_t inputPortValue(uint16_t inputs, uint16_t outputs, uint16_t inputMask, uint16_t polarity) {
+  return ((inputs & inputMask) | (outputs & ~inputMask)) ^ polarity;
+}
+
+#endif /* PCA9535_REGS_H */
@@ -0,0 +1,65 @@
+// Binary pin-event trace format, shared by the chip and
+// tools/trace2vcd.c
+//
+// SPDX-License-Identifier: MIT
+
+#ifndef PCA9535_TRACE_H
+#define PCA9535_TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_FORMAT_VERSION  1
+
+// trace chunks are written to the console as lines of hex,
+// prefixed with this so they can be picked out of the log
+#define TRACE_LINE_PREFIX  "#PCA9535TRACE "
+
+/*
+  Each record is 8 bytes, little endian:
+    uint32  delta    ns since the previous record
+    uint8   type     trace_event_t
+    uint8   source   chip instance (high 3 bits) | arg (low 5 bits)
+    uint16  value
+  A gap longer than a uint32 of ns is bridged with TRACE_EV_WAIT
+  records, which only advance time.
+*/
+#define TRACE_RECORD_SIZE  8
+#define TRACE_ARG_MASK     0x1f
+#define TRACE_CHIP_SHIFT   5
+#define TRACE_MAX_DELTA    0xffffffffu
+
+typedef enum {
+  TRACE_EV_HEADER = 0,      // value: TRACE_FORMAT_VERSION
+  TRACE_EV_WAIT,            // time only
+  TRACE_EV_PIN_EDGE,        // arg: io index, value: level
+  TRACE_EV_DIRECTION,       // value: input mask (1 = input)
+  TRACE_EV_OUTPUT,          // value: output latch as applied
+  TRACE_EV_INT,             // value: 1 asserted (nINT low), 0 released
+  TRACE_EV_I2C_CONNECT,     // arg: 1 read / 0 write, value: address
+  TRACE_EV_I2C_WRITE,       // value: byte from the MCU
+  TRACE_EV_I2C_READ,        // value: byte returned to the MCU
+  TRACE_EV_I2C_DISCONNECT,
+  TRACE_EV_KEY,             // value: key event, as queued in KP_FIFO
+  TRACE_EV_NUM_EVENTS
+} trace_event_t;
+
+typedef struct {
+  uint32_t delta;
+  uint8_t type;
+  uint8_t source;
+  uint16_t value;
+} trace_record_t;
+
+static inline uint8_t traceSource(uint8_t chipIdx, uint8_t arg) {
+  return (uint8_t)((chipIdx << TRACE_CHIP_SHIFT) | (arg & TRACE_ARG_MASK));
+}
+
+static inline uint8_t traceChip(const trace_record_t * rec) {
+  return rec->source >> TRACE_CHIP_SHIFT;
+}
+
+static inline uint8_t traceArg(const trace_record_t * rec) {
+  return rec->source & TRACE_ARG_MASK;
+}
+
+#endif /* PCA9535_TRACE_H */
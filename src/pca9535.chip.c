@@ -5,21 +5,529 @@
 // Copyright 2023 Pat Deegan, https://psychogenic.com
 
 #include "wokwi-api.h"
-#include <stdio.h>
-#include <stdlib.h>
+#include "pca9535-host.h"
+#include "pca9535-regs.h"
+#include "pca9535-trace.h"
 
-#define I2C_BASE_ADDRESS 0x20
-#define NUM_GPIO  16
 #define NUM_ADDR_BITS  3
 
+// Extension registers, past the datasheet map.  Command bytes 
+// below REG_EXT_BASE keep the datasheet decoding (low 3 bits),
+// the pointer moves sequentially through extension registers.
+#define REG_EXT_BASE   0x10
+
+// key matrix scan, see "Key matrix scan" below
+#define REG_KP_CTRL    0x10
+#define REG_KP_ROWS0   0x11
+#define REG_KP_ROWS1   0x12
+#define REG_KP_COLS0   0x13
+#define REG_KP_COLS1   0x14
+#define REG_KP_PERIOD  0x15
+#define REG_KP_COUNT   0x16
+#define REG_KP_FIFO    0x17
+#define REG_KP_KEYS0   0x18
+#define REG_KP_KEYS7   0x1f
+
+// interrupt enable, per pin (1 = changes on it raise nINT)
+#define REG_INT_ENABLE0  0x20
+#define REG_INT_ENABLE1  0x21
+
+// change capture: every input that changed since this was last
+// read (reading clears), and whether nINT waits for that read
+#define REG_CAPTURE0      0x22
+#define REG_CAPTURE1      0x23
+#define REG_CAPTURE_CTRL  0x24
+
+// edge counters: which edges count on which pins, a write-1 clear,
+// and one 32-bit little endian counter per pin at 0x40 + 4 * pin
+#define REG_CNT_RISE0    0x30
+#define REG_CNT_RISE1    0x31
+#define REG_CNT_FALL0    0x32
+#define REG_CNT_FALL1    0x33
+#define REG_CNT_CLEAR0   0x34
+#define REG_CNT_CLEAR1   0x35
+#define REG_CNT_BASE     0x40
+#define REG_CNT_LAST     0x7f
+
+// PWM: pins, shared period (us) and a duty byte per pin
+#define REG_PWM_ENABLE0  0x80
+#define REG_PWM_ENABLE1  0x81
+#define REG_PWM_PERIOD0  0x82
+#define REG_PWM_PERIOD1  0x83
+#define REG_PWM_DUTY0    0x90
+#define REG_PWM_DUTY15   0x9f
+
+// The datasheet auto-increments within a register pair (0<->1, 
+// 2<->3...).  Set this to 1 to have the pointer move on to the 
+// next pair instead, so e.g. output and config can be written 
+// in a single burst.  This, and the other build-time defaults
+// below, can be overridden per chip through attributes.
+#ifndef REG_AUTOINC_SEQUENTIAL
+#define REG_AUTOINC_SEQUENTIAL 0
+#endif
+
+// Edge coalescing window.  When non-zero, input edges only
+// update inputValue and the INT decision is deferred by this
+// long, so a burst of edges gives a single evaluation.
+#ifndef COALESCE_WINDOW_NS
+#define COALESCE_WINDOW_NS 0
+#endif
+
+// Poll-on-read mode, for inputs fed with fast signals the firmware 
+// only samples now and then.  Inputs are not watched at all, they 
+// are sampled when a read starts and, if INPUT_POLL_INTERVAL_US is
+// set, from a low-rate timer that also drives nINT.  Without the
+// interval input changes never assert nINT (a warning at init).
+#ifndef INPUT_POLL_MODE
+#define INPUT_POLL_MODE 0
+#endif
+#ifndef INPUT_POLL_INTERVAL_US
+#define INPUT_POLL_INTERVAL_US 0
+#endif
+
+// Output drive.  By default a HIGH output is released and pulled 
+// up, open-drain style, so it can be overdriven without a conflict.
+// Push-pull actively drives it HIGH, as the real totem-pole outputs
+// do.  The PCF8575 is quasi-bidirectional and always open-drain.
+#ifndef OUTPUT_PUSH_PULL
+#define OUTPUT_PUSH_PULL 0
+#endif
+
+// Commit on STOP.  Output and configuration writes normally reach
+// the pins as each register pair completes.  With this set they are
+// held until the transaction ends (STOP, or a repeated start), and
+// all 16 pins change in one batch, so whatever is wired downstream
+// sees a single transition rather than one per pair.
+#ifndef COMMIT_ON_STOP
+#define COMMIT_ON_STOP 0
+#endif
+
+// Answer the I2C General Call (address 0): a 0x06 resets every 
+// instance to its power-on state, as if the simulation restarted.
+#ifndef GENERAL_CALL_RESET
+#define GENERAL_CALL_RESET 1
+#endif
+
+// Port state display refresh cap, 0 turns the display off.
+// Only has an effect if chip.json declares a display.
+#ifndef DISPLAY_FPS
+#define DISPLAY_FPS 30
+#endif
+
+// Chip states come from a static pool rather than malloc,
+// one slot per expander (0x20-0x27 gives eight), each slot
+// on its own cache line(s)
+#ifndef CHIP_MAX_INSTANCES
+#define CHIP_MAX_INSTANCES  8
+#endif
+#define CHIP_STATE_ALIGN  64
+
+// pin_t -> io bit index lookup, pin ids handed out by 
+// pin_init are small so a flat table covers them
+#define PIN_LOOKUP_SIZE  64
+#define PIN_NOT_IO  0xff
+
+// key matrix: up to 8x8 keys, and how many events are queued
+// for the firmware (must be a power of two)
+#define KEYPAD_MAX_LINES  8
+#define KEYPAD_FIFO_SIZE  16
+
 #define CHIPSTATE_FROM(usr_dat) chip_state_t * chip = (chip_state_t*)usr_dat
-#define PRINTF_INPUTVALUE(msg, val)   printf("%s 0x%x (p0 0x%x, p1 0x%x)", msg, val, (val & 0xff), ((val & 0xff00) >> 8))
+
+
+/* Host call accounting
+  Every import goes through the counting host*() shims of 
+  pca9535-host.h.  Counters can be read through the exported 
+  pca9535HostCalls(), dumped with pca9535StatsDump() and, if 
+  HOST_STATS_DUMP_INTERVAL_MS is set, are printed periodically.
+*/
+#ifndef HOST_STATS_DUMP_INTERVAL_MS
+#define HOST_STATS_DUMP_INTERVAL_MS 0
+#endif
+
+#if CHIP_HOST_STATS
+
+__attribute__((export_name("pca9535HostCalls")))
+uint32_t pca9535_host_calls(uint32_t context, uint32_t call) {
+  if (context >= HOSTCTX_NUM_CONTEXTS || call >= HOSTCALL_NUM_CALLS) {
+    return 0;
+  }
+  return hostStats.counts[context][call];
+}
+
+void dumpInstances(void);
+void pca9535_int_stats_dump(void);
+
+__attribute__((export_name("pca9535StatsDump")))
+void pca9535_stats_dump(void) {
+  dumpInstances();
+  pca9535_int_stats_dump();
+  hostStatsPrint();
+}
+
+void hostStatsDumpTimerCallback(void *user_data) {
+  HOST_CONTEXT(HOSTCTX_TIMER);
+  pca9535_stats_dump();
+}
+
+void hostStatsInit(void) {
+  hostStats.context = HOSTCTX_INIT;
+#if HOST_STATS_DUMP_INTERVAL_MS
+  const timer_config_t dumpTimerConfig = {
+    .callback = hostStatsDumpTimerCallback,
+    .user_data = NULL,
+  };
+  hostStats.dumpTimer = hostTimerInit(&dumpTimerConfig);
+  hostTimerStart(hostStats.dumpTimer, HOST_STATS_DUMP_INTERVAL_MS * 1000, true);
+#endif
+}
+
+#else
+
+void hostStatsInit(void) {}
+
+#endif /* CHIP_HOST_STATS */
+
+
+/* Log messages
+  Event ids and formats for the logger in pca9535-host.h.
+*/
+typedef enum {
+  LOGEV_INT_SET = 0,
+  LOGEV_INT_RESET_ON_READ,
+  LOGEV_ADDR_MISMATCH,
+  LOGEV_INPUT_MASK,
+  LOGEV_INPUT_CHANGED,
+  LOGEV_ADDRESS,
+  LOGEV_I2C_INIT,
+  LOGEV_POOL_EXHAUSTED,
+  LOGEV_UNKNOWN_VARIANT,
+  LOGEV_KEYPAD_SCAN,
+  LOGEV_STATE_REJECTED,
+  LOGEV_SOFT_RESET,
+  LOGEV_POLL_NO_INT,
+  LOGEV_NUM_EVENTS
+} log_event_t;
+
+// each format takes (at most) the two record arguments
+static const char * const logFormats[LOGEV_NUM_EVENTS] = {
+  [LOGEV_INT_SET] = "INT flag SET\n",
+  [LOGEV_INT_RESET_ON_READ] = "Read: reset INT flag\n",
+  [LOGEV_ADDR_MISMATCH] = "Getting connects for address 0x%x but am at 0x%x\n",
+  [LOGEV_INPUT_MASK] = "Input mask is now 0x%x\n",
+  [LOGEV_INPUT_CHANGED] = "I/O input changed: from 0x%04x to 0x%04x\n",
+  [LOGEV_ADDRESS] = "Chip LSB bits set to %i.  Address is 0x%02x\n",
+  [LOGEV_I2C_INIT] = "I2C initialized @ address 0x%x (variant %u)\n",
+  [LOGEV_POOL_EXHAUSTED] = "No free chip slot (max %u instances), chip disabled\n",
+  [LOGEV_UNKNOWN_VARIANT] = "Unknown variant attribute, using pca9535\n",
+  [LOGEV_KEYPAD_SCAN] = "Key scan: rows 0x%04x, columns 0x%04x\n",
+  [LOGEV_STATE_REJECTED] = "Chip %u: saved state rejected (%u)\n",
+  [LOGEV_SOFT_RESET] = "Chip %u: soft reset\n",
+  [LOGEV_POLL_NO_INT] = "Chip %u: pollInputs without pollIntervalUs, input changes never assert nINT\n",
+};
+
+// per-instance variants, also filtered by the chip's logLevel attribute
+#define CHIP_LOG_AT(chip, lvl, ev, a0, a1) do { \
+    if ((lvl) <= CHIP_LOG_LEVEL && (lvl) <= (chip)->config.logLevel) { logRecord((ev), (a0), (a1)); } \
+  } while (0)
+
+#define CHIP_LOG_WARN(chip, ev, a0, a1)   CHIP_LOG_AT(chip, LOG_LEVEL_WARN, ev, a0, a1)
+#define CHIP_LOG_INFO(chip, ev, a0, a1)   CHIP_LOG_AT(chip, LOG_LEVEL_INFO, ev, a0, a1)
+#define CHIP_LOG_DEBUG(chip, ev, a0, a1)  CHIP_LOG_AT(chip, LOG_LEVEL_DEBUG, ev, a0, a1)
+
+
+/* Event trace
+  With CHIP_TRACE, every pin edge, direction/output change, nINT 
+  transition and i2c event is recorded with its sim timestamp as an
+  8-byte binary record (format in pca9535-trace.h).  Records pile
+  up in a large buffer and are only written out, as hex lines, when
+  it fills, when the flush timer goes off or through the exported 
+  pca9535TraceFlush().  tools/trace2vcd turns the log into a VCD.
+*/
+#ifndef CHIP_TRACE
+#define CHIP_TRACE 0
+#endif
+
+// must be a multiple of TRACE_RECORDS_PER_LINE
+#define TRACE_BUFFER_RECORDS    1024
+#define TRACE_RECORDS_PER_LINE  32
+#define TRACE_FLUSH_DELAY_US    100000
+
+#if CHIP_TRACE
+
+typedef struct {
+  trace_record_t records[TRACE_BUFFER_RECORDS];
+  uint32_t count;
+  uint64_t lastTime;
+  timer_t flushTimer;
+  bool flushTimerValid;
+} trace_buffer_t;
+
+static trace_buffer_t traceBuffer;
+
+void traceWriteLine(const trace_record_t * records, uint32_t count) {
+  static const char hexDigits[] = "0123456789abcdef";
+  char line[sizeof(TRACE_LINE_PREFIX) + (TRACE_RECORDS_PER_LINE * TRACE_RECORD_SIZE * 2) + 1];
+  uint32_t len = 0;
+
+  for (const char * p = TRACE_LINE_PREFIX; *p; p++) {
+    line[len++] = *p;
+  }
+
+  const uint8_t * bytes = (const uint8_t *)records;
+  for (uint32_t i=0; i<count * TRACE_RECORD_SIZE; i++) {
+    line[len++] = hexDigits[bytes[i] >> 4];
+    line[len++] = hexDigits[bytes[i] & 0x0f];
+  }
+  line[len++] = '\n';
+
+  chipWrite(line, len);
+}
+
+// native harnesses (bench/replay.c) take the records 
+// directly, rather than as hex on the console
+#ifdef CHIP_TRACE_SINK
+void CHIP_TRACE_SINK(const trace_record_t * records, uint32_t count);
+#endif
+
+__attribute__((export_name("pca9535TraceFlush")))
+void pca9535_trace_flush(void) {
+#ifdef CHIP_TRACE_SINK
+  CHIP_TRACE_SINK(traceBuffer.records, traceBuffer.count);
+#else
+  for (uint32_t i=0; i<traceBuffer.count; i += TRACE_RECORDS_PER_LINE) {
+    uint32_t n = traceBuffer.count - i;
+    traceWriteLine(&(traceBuffer.records[i]), n < TRACE_RECORDS_PER_LINE ? n : TRACE_RECORDS_PER_LINE);
+  }
+#endif
+  traceBuffer.count = 0;
+}
+
+void traceFlushTimerCallback(void *user_data) {
+  HOST_CONTEXT(HOSTCTX_TIMER);
+  pca9535_trace_flush();
+}
+
+void tracePut(uint32_t delta, uint8_t type, uint8_t source, uint16_t value) {
+  if (traceBuffer.count >= TRACE_BUFFER_RECORDS) {
+    pca9535_trace_flush();
+  }
+
+  if (! traceBuffer.count && traceBuffer.flushTimerValid) {
+    // make sure a quiet tail still makes it out
+    hostTimerStart(traceBuffer.flushTimer, TRACE_FLUSH_DELAY_US, false);
+  }
+
+  trace_record_t * rec = &(traceBuffer.records[traceBuffer.count++]);
+  rec->delta = delta;
+  rec->type = type;
+  rec->source = source;
+  rec->value = value;
+}
+
+void traceRecord(uint8_t type, uint8_t chipIdx, uint8_t arg, uint16_t value) {
+  uint64_t now = hostSimNanos();
+  uint64_t delta = (now > traceBuffer.lastTime) ? (now - traceBuffer.lastTime) : 0;
+  traceBuffer.lastTime = now;
+
+  while (delta > TRACE_MAX_DELTA) {
+    tracePut(TRACE_MAX_DELTA, TRACE_EV_WAIT, 0, 0);
+    delta -= TRACE_MAX_DELTA;
+  }
+  tracePut((uint32_t)delta, type, traceSource(chipIdx, arg), value);
+}
+
+void traceInit(void) {
+  const timer_config_t flushTimerConfig = {
+    .callback = traceFlushTimerCallback,
+    .user_data = NULL,
+  };
+  traceBuffer.count = 0;
+  traceBuffer.lastTime = 0;
+  traceBuffer.flushTimer = hostTimerInit(&flushTimerConfig);
+  traceBuffer.flushTimerValid = true;
+  traceRecord(TRACE_EV_HEADER, 0, 0, TRACE_FORMAT_VERSION);
+}
+
+#define TRACE(type, chip, arg, value)  do { \
+    if ((chip)->config.trace) { traceRecord((type), (chip)->instanceIdx, (arg), (value)); } \
+  } while (0)
+
+// sim time of the latest record, for anything timed off the trace
+uint64_t traceLastTime(void) {
+  return traceBuffer.lastTime;
+}
+
+#else
+
+#define TRACE(type, chip, arg, value)  do {} while (0)
+
+void traceInit(void) {}
+
+uint64_t traceLastTime(void) {
+  return 0;
+}
+
+#endif /* CHIP_TRACE */
+
+
+/* Variants
+  Pin-compatible 16-bit expanders the chip can stand in for, 
+  selected by the "variant" attribute.  Each gets its own set of
+  callbacks (see chipVariants, after the callbacks themselves), 
+  installed once at init.
+*/
+typedef enum {
+  VARIANT_PCA9535 = 0,
+  VARIANT_PCA9555,
+  VARIANT_TCA6416,
+  VARIANT_PCF8575,
+  NUM_VARIANTS
+} variant_id_t;
+
+typedef struct chip_variant {
+  const char * name;
+  uint8_t baseAddress;
+  uint8_t numAddrBits;
+  uint32_t inputPinMode;
+  bool quasiBidirectional;
+  bool (*connect)(void *user_data, uint32_t address, bool read);
+  uint8_t (*read)(void *user_data);
+  bool (*write)(void *user_data, uint8_t data);
+  void (*disconnect)(void *user_data);
+  void (*pin_change)(void *user_data, pin_t pin, uint32_t value);
+} chip_variant_t;
+
+
+/* Per-chip configuration
+  Filled once in chip_init from the diagram attributes (falling 
+  back to the build-time defaults above), hot paths only ever 
+  read these plain fields.
+*/
+typedef struct {
+  uint8_t variant;
+  uint8_t logLevel;
+  bool trace;
+  bool sequentialAutoInc;
+  bool commitOnStop;
+  uint32_t coalesceWindowNs;
+  bool pollInputs;
+  uint32_t pollIntervalUs;
+  uint32_t displayFps;
+  bool pushPull;
+} chip_config_t;
+
+
+/* Interrupt latency statistics
+  Per instance, how long nINT stays asserted until a read clears
+  it (log2 buckets of sim ns: bucket i counts [2^i, 2^(i+1)) ns),
+  and how input changes were folded into, or lost from, an 
+  assertion.  Transitions only: an nINT edge costs at most one
+  get_sim_nanos, and none when a trace record was just written,
+  whose timestamp is reused.  -DCHIP_INT_STATS=0 compiles the
+  collection out.
+*/
+#ifndef CHIP_INT_STATS
+#define CHIP_INT_STATS 1
+#endif
+
+#define INT_LATENCY_BUCKETS  32
+
+typedef enum {
+  INTSTAT_ASSERTIONS = 0,
+  INTSTAT_CLEARED_BY_READ,
+  // input changes while already asserted, seen as one
+  INTSTAT_FOLDED,
+  // released unread, the inputs went back to what was last read
+  INTSTAT_LOST,
+  INTSTAT_MAX_LATENCY_NS,
+  INTSTAT_NUM_COUNTERS
+} int_stat_t;
+
+typedef struct {
+  uint64_t assertedAt;
+  uint32_t counters[INTSTAT_NUM_COUNTERS];
+  uint32_t latency[INT_LATENCY_BUCKETS];
+} int_stats_t;
+
+
+/* Key matrix scan state
+  Row and column masks are latched as written and only take 
+  effect on the next KP_CTRL write.  Debounce state is kept 
+  per row, one bit per column.
+*/
+typedef struct {
+  // registers as written
+  uint8_t ctrl;
+  uint16_t rowReg;
+  uint16_t colReg;
+  uint8_t period;
+
+  // scan as applied: io indices of the rows/columns in use,
+  // and every pin the scan owns
+  uint16_t pins;
+  uint8_t rowIo[KEYPAD_MAX_LINES];
+  uint8_t colIo[KEYPAD_MAX_LINES];
+  uint8_t numRows;
+  uint8_t numCols;
+  uint8_t debounce;
+  uint8_t row;        // row currently driven low
+  timer_t timer;
+
+  // per row: last raw sample, how many scans in a row it was 
+  // seen, and the debounced key state
+  uint8_t raw[KEYPAD_MAX_LINES];
+  uint8_t stableScans[KEYPAD_MAX_LINES];
+  uint8_t keys[KEYPAD_MAX_LINES];
+  uint8_t keysSnapshot[KEYPAD_MAX_LINES];
+
+  // key events waiting to be read
+  uint8_t fifo[KEYPAD_FIFO_SIZE];
+  uint8_t fifoHead;
+  uint8_t fifoTail;
+  bool overflow;
+} keypad_state_t;
+
+
+/* PWM state
+  Registers are latched as written and applied when the 
+  transaction ends.  The applied waveform is a schedule of steps 
+  within one period: step 0 raises every modulated pin, each 
+  following step lowers the pins whose high time ends there.
+*/
+typedef struct {
+  // registers as written
+  uint16_t pins;
+  uint16_t periodUs;
+  uint8_t duty[NUM_GPIO];
+  bool pending;
+
+  // as applied: pins the PWM drives (including duty 0 / 255, 
+  // which are held steady) and the level it has them at
+  uint16_t driven;
+  uint16_t level;
+
+  uint16_t stepPins[NUM_GPIO + 1];
+  uint32_t stepAtNs[NUM_GPIO + 1];
+  uint32_t periodNs;
+  uint8_t numSteps;
+  uint8_t step;       // next step the timer runs
+  timer_t timer;
+} pwm_state_t;
 
 
 /* Chip state structure 
    Everything we care about and need access to in callbacks.
 */
-typedef struct {
+typedef struct __attribute__((aligned(CHIP_STATE_ALIGN))) {
+  // slot in the instance pool
+  uint8_t instanceIdx;
+
+  chip_config_t config;
+  const chip_variant_t * variant;
+  uint32_t inputPinMode;
+  uint32_t outputHighMode;
+
   // address bit pins and device address
   uint8_t address;
   pin_t addressBits[NUM_ADDR_BITS];
@@ -27,162 +535,1304 @@ typedef struct {
   // interrupt and "bidir" i/o pins
   pin_t nINT;
   pin_t io[NUM_GPIO];
+  uint8_t ioBitFromPin[PIN_LOOKUP_SIZE];
 
-  // input configuration and read value
+  // input configuration and read value, as currently 
+  // applied to the pins
   uint16_t inputMask;
   uint16_t inputValue;
   uint16_t lastReadValue;
+  uint16_t appliedOutput;
+
+  // register file (16-bit, port 1 in the high byte). 
+  // output and config are staged here as written over i2c 
+  // and only applied to the pins once a pair is complete
+  // (or the transaction ends)
+  uint16_t outputReg;
+  uint16_t polarityReg;
+  uint16_t configReg;
+  bool stagedPending;
+
+  // set while a commit changes pin modes, edges arriving 
+  // meanwhile are only noted and handled once it is done
+  bool reconfiguring;
+  uint16_t reconfigEdges;
+
+  // extension: which inputs may raise nINT
+  uint16_t intEnableReg;
+
+  // extension: sticky change capture
+  uint16_t captureReg;
+  uint16_t captureSnapshot;
+  uint8_t captureCtrl;
+
+  // extension: edge counters, and their values as of the current read
+  uint16_t countRising;
+  uint16_t countFalling;
+  uint32_t counters[NUM_GPIO];
+  uint32_t countersSnapshot[NUM_GPIO];
 
   // i2c configuration, device and 
-  // byte count/port count tracking
+  // command/register pointer tracking
   i2c_dev_t i2c_dev;
   i2c_config_t i2c_config;
-  uint8_t i2c_portcount;
+  uint8_t regPointer;
+  bool expectCommand;
+
+  // register file as it stood when the current read started
+  uint8_t readSnapshot[NUM_REGS];
+  uint16_t snapshotInputs;
+  uint8_t pairWriteCount;
 
   // our pin watch config for bidir 
   // io, so we can start/stop watching
   // depending on user settings writes
   pin_watch_config_t io_watch_config;
 
+  // edge coalescing: timer and whether an 
+  // evaluation is already scheduled
+  timer_t coalesceTimer;
+  bool evaluationPending;
+
+  // poll-on-read: inputs aren't watched, just sampled
+  timer_t pollTimer;
+
+  // nINT line state, as last driven
+  bool intAsserted;
+
+  // port state display: rows needing a redraw (pins, 
+  // then nINT) and whether a frame is already scheduled
+  buffer_t display;
+  uint32_t displayWidth;
+  uint32_t displayHeight;
+  uint32_t displayDirty;
+  bool framePending;
+  timer_t frameTimer;
+
+  keypad_state_t keypad;
+  pwm_state_t pwm;
+
+  int_stats_t intStats;
+
 } chip_state_t;
 
 
+/* Instance pool and registry
+  Slots are handed out in order and never released (chips live
+  for the whole simulation), so the live instances are simply
+  the first chipInstanceCount entries.
+*/
+static chip_state_t chipPool[CHIP_MAX_INSTANCES];
+static uint8_t chipInstanceCount;
+
+chip_state_t * chipAlloc(void) {
+  if (chipInstanceCount >= CHIP_MAX_INSTANCES) {
+    return NULL;
+  }
+  chipPool[chipInstanceCount].instanceIdx = chipInstanceCount;
+  return &(chipPool[chipInstanceCount++]);
+}
+
+uint8_t chipNumInstances(void) {
+  return chipInstanceCount;
+}
+
+uint16_t readInputsValue(chip_state_t * chip);
+void evaluateInputs(chip_state_t * chip);
+void pollSampleInputs(chip_state_t * chip);
+uint32_t pinModeFor(const chip_state_t * chip, bool isInput, bool level);
+void commitPinConfig(chip_state_t * chip);
+void pwmApply(chip_state_t * chip);
+bool keypadEventPending(const chip_state_t * chip);
+
+chip_state_t * chipInstance(uint8_t idx) {
+  if (idx >= chipInstanceCount) {
+    return NULL;
+  }
+  return &(chipPool[idx]);
+}
+
+/*
+  Read an attribute, or its default when the diagram doesn't set it.
+*/
+uint32_t configAttr(const char * name, uint32_t defaultValue) {
+  HOST_COUNT(HOSTCALL_OTHER);
+  return attr_read(attr_init(name, defaultValue));
+}
+
+float configAttrFloat(const char * name, float defaultValue) {
+  HOST_COUNT(HOSTCALL_OTHER);
+  return attr_read_float(attr_init_float(name, defaultValue));
+}
+
+/*
+  Case-insensitive string compare, we don't have (or want) libc.
+*/
+bool namesMatch(const char * a, const char * b) {
+  for (;; a++, b++) {
+    char ca = (*a >= 'A' && *a <= 'Z') ? (*a + 'a' - 'A') : *a;
+    char cb = (*b >= 'A' && *b <= 'Z') ? (*b + 'a' - 'A') : *b;
+    if (ca != cb) {
+      return false;
+    }
+    if (! ca) {
+      return true;
+    }
+  }
+}
+
+uint8_t configVariant(void) {
+  static const char * const variantNames[NUM_VARIANTS] = {
+    [VARIANT_PCA9535] = "pca9535",
+    [VARIANT_PCA9555] = "pca9555",
+    [VARIANT_TCA6416] = "tca6416",
+    [VARIANT_PCF8575] = "pcf8575",
+  };
+  char name[16];
+
+  HOST_COUNT(HOSTCALL_OTHER);
+  string_t attr = attr_string_init("variant");
+  if (attr == STRING_NULL) {
+    return VARIANT_PCA9535;
+  }
+  string_read(attr, name, sizeof(name));
+  name[sizeof(name) - 1] = '\0';
+
+  for (uint8_t v=0; v<NUM_VARIANTS; v++) {
+    if (namesMatch(name, variantNames[v])) {
+      return v;
+    }
+  }
+  LOG_WARN(LOGEV_UNKNOWN_VARIANT, 0, 0);
+  return VARIANT_PCA9535;
+}
+
+void loadConfig(chip_config_t * config) {
+  config->variant = configVariant();
+  config->logLevel = configAttr("logLevel", CHIP_LOG_LEVEL);
+  config->trace = configAttr("trace", CHIP_TRACE) != 0;
+  config->sequentialAutoInc = configAttr("autoIncrement", REG_AUTOINC_SEQUENTIAL) != 0;
+  config->commitOnStop = configAttr("commitOnStop", COMMIT_ON_STOP) != 0;
+  config->coalesceWindowNs = configAttrFloat("coalesceUs", COALESCE_WINDOW_NS / 1000.0f) * 1000.0f;
+  config->pollInputs = configAttr("pollInputs", INPUT_POLL_MODE) != 0;
+  config->pollIntervalUs = configAttr("pollIntervalUs", INPUT_POLL_INTERVAL_US);
+  config->displayFps = configAttr("displayFps", DISPLAY_FPS);
+  config->pushPull = configAttr("pushPull", OUTPUT_PUSH_PULL) != 0;
+}
+
+void dumpInstances(void) {
+  for (uint8_t i=0; i<chipNumInstances(); i++) {
+    const chip_state_t * chip = chipInstance(i);
+    chipPrintf("chip %u @ 0x%02x: config 0x%04x output 0x%04x inputs 0x%04x\n", 
+            i, chip->address, chip->configReg, chip->outputReg, chip->inputValue);
+  }
+}
+
+
+
+/* Port state display
+  One horizontal band per pin, P00 at the top, then one for nINT: a
+  direction stripe (blue input, orange output) followed by the level
+  (green high, grey low; red while nINT is asserted).
+  Changes only mark rows dirty; a one-shot frame timer, armed by the 
+  first change after a frame, redraws just those rows.  So however 
+  busy the pins are, we write at most one frame per refresh interval.
+*/
+#define DISPLAY_ROW_HEIGHT    6
+#define DISPLAY_NUM_ROWS      (NUM_GPIO + 1)
+#define DISPLAY_INT_ROW       NUM_GPIO
+#define DISPLAY_STRIPE_WIDTH  8
+// buffer_write takes at most 255 bytes per call
+#define DISPLAY_MAX_WIDTH     63
+
+typedef struct {
+  uint8_t r, g, b, a;
+} pixel_t;
+
+static const pixel_t pixelInput = {0x20, 0x60, 0xff, 0xff};
+static const pixel_t pixelOutput = {0xff, 0x90, 0x20, 0xff};
+static const pixel_t pixelHigh = {0x30, 0xe0, 0x30, 0xff};
+static const pixel_t pixelLow = {0x30, 0x30, 0x30, 0xff};
+static const pixel_t pixelIntAsserted = {0xff, 0x20, 0x20, 0xff};
+static const pixel_t pixelNeutral = {0x80, 0x80, 0x80, 0xff};
+static const pixel_t pixelBlack = {0, 0, 0, 0xff};
+
+void displayMarkDirty(chip_state_t * chip, uint32_t rows) {
+  if (! chip->display || ! rows) {
+    return;
+  }
+  chip->displayDirty |= rows;
+  if (! chip->framePending) {
+    chip->framePending = true;
+    hostTimerStart(chip->frameTimer, 1000000 / chip->config.displayFps, false);
+  }
+}
+
+void displayDrawRow(chip_state_t * chip, uint8_t row) {
+  pixel_t line[DISPLAY_MAX_WIDTH];
+  uint32_t width = chip->displayWidth < DISPLAY_MAX_WIDTH ? chip->displayWidth : DISPLAY_MAX_WIDTH;
+  const pixel_t * stripe;
+  const pixel_t * level;
+
+  if (row == DISPLAY_INT_ROW) {
+    stripe = &pixelNeutral;
+    level = chip->intAsserted ? &pixelIntAsserted : &pixelLow;
+  } else {
+    uint16_t bit = (1 << row);
+    bool isInput = chip->inputMask & bit;
+    bool high = isInput ? (chip->inputValue & bit) : (chip->appliedOutput & bit);
+    stripe = isInput ? &pixelInput : &pixelOutput;
+    level = high ? &pixelHigh : &pixelLow;
+  }
+
+  for (uint32_t x=0; x<width; x++) {
+    line[x] = (x < DISPLAY_STRIPE_WIDTH) ? *stripe : *level;
+  }
+
+  // last pixel row of each band is a separator
+  uint32_t y = row * DISPLAY_ROW_HEIGHT;
+  for (uint8_t i=0; i<DISPLAY_ROW_HEIGHT && y < chip->displayHeight; i++, y++) {
+    if (i == DISPLAY_ROW_HEIGHT - 1) {
+      for (uint32_t x=0; x<width; x++) {
+        line[x] = pixelBlack;
+      }
+    }
+    hostBufferWrite(chip->display, y * chip->displayWidth * sizeof(pixel_t), (uint8_t *)line, width * sizeof(pixel_t));
+  }
+}
+
+void chip_frame_timer_done(void *user_data) {
+  HOST_CONTEXT(HOSTCTX_TIMER);
+  CHIPSTATE_FROM(user_data);
+  uint32_t dirty = chip->displayDirty;
+
+  chip->displayDirty = 0;
+  chip->framePending = false;
+  for (uint8_t row=0; row<DISPLAY_NUM_ROWS; row++) {
+    if (dirty & (1 << row)) {
+      displayDrawRow(chip, row);
+    }
+  }
+}
+
+void displayInit(chip_state_t * chip) {
+  uint32_t width = 0;
+  uint32_t height = 0;
+
+  chip->display = 0;
+  chip->displayDirty = 0;
+  chip->framePending = false;
+  if (! chip->config.displayFps) {
+    return;
+  }
+
+  buffer_t fb = framebuffer_init(&width, &height);
+  if (! width || ! height) {
+    // no display declared in chip.json
+    return;
+  }
+
+  const timer_config_t frame_timer_config = {
+    .callback = chip_frame_timer_done,
+    .user_data = chip,
+  };
+  chip->frameTimer = hostTimerInit(&frame_timer_config);
+  chip->displayWidth = width;
+  chip->displayHeight = height;
+  chip->display = fb;
+
+  // initial frame, everything
+  displayMarkDirty(chip, (1 << DISPLAY_NUM_ROWS) - 1);
+}
+
+
+#if CHIP_INT_STATS
+
+/*
+  Both are called right after the transition's TRACE, so a
+  traced instance reuses its timestamp.
+*/
+uint64_t intStatsNow(const chip_state_t * chip) {
+  if (CHIP_TRACE && chip->config.trace) {
+    return traceLastTime();
+  }
+  return hostSimNanos();
+}
+
+void intStatsAsserted(chip_state_t * chip) {
+  chip->intStats.assertedAt = intStatsNow(chip);
+  chip->intStats.counters[INTSTAT_ASSERTIONS]++;
+}
+
+void intStatsClearedByRead(chip_state_t * chip) {
+  int_stats_t * stats = &(chip->intStats);
+  stats->counters[INTSTAT_CLEARED_BY_READ]++;
+
+  uint64_t latency = intStatsNow(chip) - stats->assertedAt;
+  uint8_t bucket = latency ? (63 - __builtin_clzll(latency)) : 0;
+
+  stats->latency[bucket < INT_LATENCY_BUCKETS ? bucket : INT_LATENCY_BUCKETS - 1]++;
+  if (latency > stats->counters[INTSTAT_MAX_LATENCY_NS]) {
+    stats->counters[INTSTAT_MAX_LATENCY_NS] = (latency > 0xffffffffu) ? 0xffffffffu : (uint32_t)latency;
+  }
+}
+
+#define INT_STAT_COUNT(chip, stat)  (chip)->intStats.counters[stat]++
+
+#else
+
+#define intStatsAsserted(chip)       do {} while (0)
+#define intStatsClearedByRead(chip)  do {} while (0)
+#define INT_STAT_COUNT(chip, stat)   do {} while (0)
+
+#endif /* CHIP_INT_STATS */
+
+__attribute__((export_name("pca9535IntStat")))
+uint32_t pca9535_int_stat(uint32_t idx, uint32_t stat) {
+  const chip_state_t * chip = chipInstance(idx);
+  if (! chip || stat >= INTSTAT_NUM_COUNTERS) {
+    return 0;
+  }
+  return chip->intStats.counters[stat];
+}
+
+__attribute__((export_name("pca9535IntLatency")))
+uint32_t pca9535_int_latency(uint32_t idx, uint32_t bucket) {
+  const chip_state_t * chip = chipInstance(idx);
+  if (! chip || bucket >= INT_LATENCY_BUCKETS) {
+    return 0;
+  }
+  return chip->intStats.latency[bucket];
+}
+
+__attribute__((export_name("pca9535IntStatsDump")))
+void pca9535_int_stats_dump(void) {
+  for (uint8_t i=0; i<chipNumInstances(); i++) {
+    const int_stats_t * stats = &(chipInstance(i)->intStats);
+    chipPrintf("chip %u nINT: %u asserted, %u cleared by read, %u folded, %u lost, max %u ns\n", i,
+            (unsigned)stats->counters[INTSTAT_ASSERTIONS], (unsigned)stats->counters[INTSTAT_CLEARED_BY_READ],
+            (unsigned)stats->counters[INTSTAT_FOLDED], (unsigned)stats->counters[INTSTAT_LOST],
+            (unsigned)stats->counters[INTSTAT_MAX_LATENCY_NS]);
+    for (uint8_t b=0; b<INT_LATENCY_BUCKETS; b++) {
+      if (stats->latency[b]) {
+        chipPrintf("  >= %u ns: %u\n", (unsigned)(1u << b), (unsigned)stats->latency[b]);
+      }
+    }
+  }
+}
+
 
 /* Interrupt flag control 
   Note: inverted logic, i.e. when interrupt is asserted
   the open-drain output is a "switch" tied to ground.
   Otherwise, it is floating.
+  The line state is shadowed in intAsserted, only actual
+  transitions reach the pin (and the trace/log).
 */
 void interruptFlagOff(chip_state_t* chip) {
-  pin_mode(chip->nINT, INPUT);
+  if (! chip->intAsserted) {
+    return;
+  }
+  hostPinMode(chip->nINT, INPUT);
+  chip->intAsserted = false;
+  TRACE(TRACE_EV_INT, chip, 0, 0);
+  displayMarkDirty(chip, 1 << DISPLAY_INT_ROW);
 }
 
 void interruptFlagOn(chip_state_t* chip) {
-  pin_mode(chip->nINT, OUTPUT_LOW);
-  printf("INT flag SET\n");
+  if (chip->intAsserted) {
+    return;
+  }
+  hostPinMode(chip->nINT, OUTPUT_LOW);
+  chip->intAsserted = true;
+  TRACE(TRACE_EV_INT, chip, 0, 1);
+  intStatsAsserted(chip);
+  displayMarkDirty(chip, 1 << DISPLAY_INT_ROW);
+  CHIP_LOG_DEBUG(chip, LOGEV_INT_SET, 0, 0);
+}
+
+/*
+  The firmware read what it was interrupted for.
+*/
+void interruptFlagReadOff(chip_state_t* chip) {
+  if (chip->intAsserted) {
+    interruptFlagOff(chip);
+    intStatsClearedByRead(chip);
+  }
+}
+
+/*
+  Whether any interrupt-enabled input differs from what 
+  the firmware last read.
+*/
+bool inputsChangedUnread(const chip_state_t * chip) {
+  return (chip->inputValue ^ chip->lastReadValue) & chip->intEnableReg;
+}
+
+/*
+  Sticky capture: with CAPTURE_CTRL bit 0 set, nINT also stays 
+  asserted while captured changes on enabled pins are unread, 
+  even if the inputs went back to what was last read.
+*/
+#define CAPTURE_CTRL_HOLD_INT  0x01
+
+bool captureUnread(const chip_state_t * chip) {
+  return (chip->captureCtrl & CAPTURE_CTRL_HOLD_INT) && (chip->captureReg & chip->intEnableReg);
+}
+
+/*
+  Anything left for the firmware to read, i.e. nINT should be asserted.
+*/
+bool interruptPending(const chip_state_t * chip) {
+  return inputsChangedUnread(chip) || keypadEventPending(chip) || captureUnread(chip);
+}
+
+/*
+  nINT decision after a register write or reconfiguration, i.e. 
+  with no new input change (the statistics only count those).
+*/
+void interruptUpdate(chip_state_t * chip) {
+  if (interruptPending(chip)) {
+    interruptFlagOn(chip);
+  } else {
+    interruptFlagOff(chip);
+  }
+}
+
+
+/* Key matrix scan
+  With KP_CTRL bit 0 set the chip scans a key matrix by itself: a
+  timer drives one row pin low at a time (the other rows pulled
+  up), samples the column pins (pulled up, so a pressed key reads
+  low) and debounces each row over KP_CTRL[7:4] consecutive
+  samples.  Key changes are queued as events and assert nINT.
+  The matrix pins themselves are neither watched nor part of 
+  the input change logic while the scan owns them.
+  Events read back from KP_FIFO: bit 7 set on press, the low 
+  bits the key number (row * 8 + column + 1), 0 once empty.
+*/
+#define KP_CTRL_ENABLE          0x01
+#define KP_CTRL_DEBOUNCE_SHIFT  4
+#define KP_EVENT_PRESSED        0x80
+#define KP_COUNT_OVERFLOW       0x80
+// KP_PERIOD is in these units, per row
+#define KP_PERIOD_UNIT_US       100
+
+uint8_t keypadEventCount(const chip_state_t * chip) {
+  return (uint8_t)(chip->keypad.fifoHead - chip->keypad.fifoTail);
+}
+
+bool keypadEventPending(const chip_state_t * chip) {
+  return chip->keypad.fifoHead != chip->keypad.fifoTail;
+}
+
+void keypadPushEvent(chip_state_t * chip, uint8_t event) {
+  keypad_state_t * kp = &(chip->keypad);
+  if (keypadEventCount(chip) >= KEYPAD_FIFO_SIZE) {
+    // firmware isn't keeping up, it gets told on the next count read
+    kp->overflow = true;
+    return;
+  }
+  kp->fifo[kp->fifoHead++ & (KEYPAD_FIFO_SIZE - 1)] = event;
+  TRACE(TRACE_EV_KEY, chip, 0, event);
+  interruptFlagOn(chip);
+}
+
+/*
+  Reading the last queued event releases nINT, unless 
+  there's an input change waiting to be read as well.
+*/
+uint8_t keypadPopEvent(chip_state_t * chip) {
+  keypad_state_t * kp = &(chip->keypad);
+  if (! keypadEventPending(chip)) {
+    return 0;
+  }
+  uint8_t event = kp->fifo[kp->fifoTail++ & (KEYPAD_FIFO_SIZE - 1)];
+
+  if (! interruptPending(chip)) {
+    interruptFlagReadOff(chip);
+  }
+  return event;
+}
+
+void keypadDriveRow(chip_state_t * chip, uint8_t row, bool active) {
+  hostPinMode(chip->io[chip->keypad.rowIo[row]], active ? OUTPUT_LOW : INPUT_PULLUP);
+}
+
+/*
+  Scan timer: the current row has been driven since the last 
+  tick, so sample its columns, then move on to the next row.
+*/
+void chip_keypad_timer_done(void *user_data) {
+  HOST_CONTEXT(HOSTCTX_TIMER);
+  CHIPSTATE_FROM(user_data);
+  keypad_state_t * kp = &(chip->keypad);
+  uint8_t row = kp->row;
+
+  uint8_t sample = 0;
+  for (uint8_t c=0; c<kp->numCols; c++) {
+    if (! hostPinRead(chip->io[kp->colIo[c]])) {
+      sample |= (1 << c);
+    }
+  }
+
+  if (sample != kp->raw[row]) {
+    kp->raw[row] = sample;
+    kp->stableScans[row] = 1;
+  } else if (kp->stableScans[row] < 0xff) {
+    kp->stableScans[row]++;
+  }
+
+  uint8_t changed = sample ^ kp->keys[row];
+  if (changed && kp->stableScans[row] >= kp->debounce) {
+    for (uint8_t c=0; c<kp->numCols; c++) {
+      if (changed & (1 << c)) {
+        uint8_t event = row * KEYPAD_MAX_LINES + c + 1;
+        keypadPushEvent(chip, (sample & (1 << c)) ? (event | KP_EVENT_PRESSED) : event);
+      }
+    }
+    kp->keys[row] = sample;
+  }
+
+  if (kp->numRows > 1) {
+    keypadDriveRow(chip, row, false);
+    kp->row = (row + 1) % kp->numRows;
+    keypadDriveRow(chip, kp->row, true);
+  }
+}
+
+/*
+  Hand the matrix pins back to the register file: direction and 
+  level as per config/output, inputs watched and resynced again.
+*/
+void keypadRelease(chip_state_t * chip) {
+  keypad_state_t * kp = &(chip->keypad);
+  uint16_t pins = kp->pins;
+  if (! pins) {
+    return;
+  }
+
+  hostTimerStop(kp->timer);
+  kp->pins = 0;
+
+  for (uint8_t i=0; i<NUM_GPIO; i++) {
+    uint16_t bit = (1 << i);
+    if (! (pins & bit)) {
+      continue;
+    }
+    bool isInput = chip->configReg & bit;
+    hostPinMode(chip->io[i], pinModeFor(chip, isInput, chip->outputReg & bit));
+    if (isInput) {
+      if (! chip->config.pollInputs) {
+        hostPinWatch(chip->io[i], &(chip->io_watch_config));
+      }
+      if (hostPinRead(chip->io[i])) {
+        chip->inputValue |= bit;
+      }
+    }
+  }
+
+  // pins coming back count as already read, they don't raise nINT
+  chip->inputMask |= chip->configReg & pins;
+  chip->appliedOutput = (chip->appliedOutput & ~pins) | (chip->outputReg & pins);
+  chip->lastReadValue = (chip->lastReadValue & ~pins) | (chip->inputValue & pins);
+  displayMarkDirty(chip, pins);
+}
+
+/*
+  Take over the row/column pins as latched in KP_ROWS/KP_COLS 
+  (at most 8 of each, rows win where they overlap) and start
+  the scan timer.
+*/
+void keypadClaim(chip_state_t * chip) {
+  keypad_state_t * kp = &(chip->keypad);
+  uint16_t rows = 0;
+  uint16_t cols = 0;
+
+  kp->numRows = 0;
+  kp->numCols = 0;
+  for (uint8_t i=0; i<NUM_GPIO; i++) {
+    uint16_t bit = (1 << i);
+    if ((kp->rowReg & bit) && kp->numRows < KEYPAD_MAX_LINES) {
+      kp->rowIo[kp->numRows++] = i;
+      rows |= bit;
+    } else if ((kp->colReg & bit) && ! (kp->rowReg & bit) && kp->numCols < KEYPAD_MAX_LINES) {
+      kp->colIo[kp->numCols++] = i;
+      cols |= bit;
+    }
+  }
+  if (! kp->numRows || ! kp->numCols) {
+    return;
+  }
+
+  uint16_t pins = rows | cols;
+  for (uint8_t i=0; i<NUM_GPIO; i++) {
+    uint16_t bit = (1 << i);
+    if (! (pins & bit)) {
+      continue;
+    }
+    if ((chip->inputMask & bit) && ! chip->config.pollInputs) {
+      hostPinWatchStop(chip->io[i]);
+    }
+    hostPinMode(chip->io[i], INPUT_PULLUP);
+  }
+
+  chip->inputMask &= ~pins;
+  chip->inputValue &= chip->inputMask;
+  chip->lastReadValue &= ~pins;
+  kp->pins = pins;
+
+  for (uint8_t r=0; r<KEYPAD_MAX_LINES; r++) {
+    kp->raw[r] = 0;
+    kp->stableScans[r] = 0;
+    kp->keys[r] = 0;
+  }
+  kp->debounce = kp->ctrl >> KP_CTRL_DEBOUNCE_SHIFT;
+  if (! kp->debounce) {
+    kp->debounce = 1;
+  }
+
+  kp->row = 0;
+  keypadDriveRow(chip, 0, true);
+  hostTimerStart(kp->timer, (kp->period ? kp->period : 1) * KP_PERIOD_UNIT_US, true);
+
+  displayMarkDirty(chip, pins);
+  CHIP_LOG_INFO(chip, LOGEV_KEYPAD_SCAN, rows, cols);
+}
+
+
+/* PWM
+  Output pins can be modulated by the chip itself: a shared 
+  period (PWM_PERIOD, in microseconds, 0 = 1 ms) and a duty per 
+  pin, high for duty/255 of the period (0 steady low, 255 steady
+  high).  One one-shot timer walks the step schedule, and each 
+  step only touches the pins that change there, so pins sharing 
+  a duty cycle toggle together.
+  PWM pins that are configured as inputs, or owned by the key 
+  scan, are left alone.  A disabled pin goes back to its output 
+  register level.
+*/
+#define PWM_DEFAULT_PERIOD_US  1000
+#define PWM_DUTY_MAX           255
+
+void pwmDrive(chip_state_t * chip, uint16_t pins, bool level) {
+  for (uint8_t i=0; i<NUM_GPIO; i++) {
+    if (pins & (1 << i)) {
+      hostPinMode(chip->io[i], level ? chip->outputHighMode : OUTPUT_LOW);
+    }
+  }
+  if (level) {
+    chip->pwm.level |= pins;
+  } else {
+    chip->pwm.level &= ~pins;
+  }
+}
+
+void pwmRunStep(chip_state_t * chip) {
+  pwm_state_t * pwm = &(chip->pwm);
+  uint8_t step = pwm->step;
+
+  if (step == 0) {
+    pwmDrive(chip, pwm->stepPins[0] & ~pwm->level, true);
+  } else {
+    pwmDrive(chip, pwm->stepPins[step] & pwm->level, false);
+  }
+
+  uint8_t next = (step + 1 < pwm->numSteps) ? step + 1 : 0;
+  uint32_t untilNext = next ? pwm->stepAtNs[next] - pwm->stepAtNs[step] 
+                            : pwm->periodNs - pwm->stepAtNs[step];
+  pwm->step = next;
+  hostTimerStartNs(pwm->timer, untilNext, false);
+}
+
+void chip_pwm_timer_done(void *user_data) {
+  HOST_CONTEXT(HOSTCTX_TIMER);
+  CHIPSTATE_FROM(user_data);
+  pwmRunStep(chip);
+}
+
+/*
+  (Re)build the schedule from the registers, restarting the period.
+*/
+void pwmApply(chip_state_t * chip) {
+  pwm_state_t * pwm = &(chip->pwm);
+  uint16_t driven = pwm->pins & ~chip->inputMask & ~chip->keypad.pins;
+  uint16_t modulated = 0;
+
+  pwm->pending = false;
+  if (pwm->numSteps) {
+    hostTimerStop(pwm->timer);
+    pwm->numSteps = 0;
+  }
+
+  // pins the PWM lets go of, back to what the output register says
+  // (the key scan has already set up the ones it took over)
+  uint16_t released = pwm->driven & ~driven & ~chip->inputMask & ~chip->keypad.pins;
+  uint16_t backHigh = released & chip->appliedOutput & ~pwm->level;
+  uint16_t backLow = released & ~chip->appliedOutput & pwm->level;
+  pwmDrive(chip, backHigh, true);
+  pwmDrive(chip, backLow, false);
+
+  // newly driven pins start from their output register level
+  uint16_t newlyDriven = driven & ~pwm->driven;
+  pwm->level = (pwm->level & pwm->driven & driven) | (chip->appliedOutput & newlyDriven);
+  pwm->driven = driven;
+
+  uint16_t high = 0;
+  uint16_t low = 0;
+  for (uint8_t i=0; i<NUM_GPIO; i++) {
+    uint16_t bit = (1 << i);
+    if (! (driven & bit)) {
+      continue;
+    }
+    if (pwm->duty[i] == 0) {
+      low |= bit;
+    } else if (pwm->duty[i] == PWM_DUTY_MAX) {
+      high |= bit;
+    } else {
+      modulated |= bit;
+    }
+  }
+  pwmDrive(chip, low & pwm->level, false);
+  pwmDrive(chip, high & ~pwm->level, true);
+  if (! modulated) {
+    return;
+  }
+
+  // falling edges in time order, pins with the same duty share a step
+  pwm->periodNs = (pwm->periodUs ? pwm->periodUs : PWM_DEFAULT_PERIOD_US) * 1000;
+  pwm->stepPins[0] = modulated;
+  pwm->stepAtNs[0] = 0;
+  pwm->numSteps = 1;
+  uint16_t remaining = modulated;
+  while (remaining) {
+    uint8_t lowest = PWM_DUTY_MAX;
+    for (uint8_t i=0; i<NUM_GPIO; i++) {
+      if ((remaining & (1 << i)) && pwm->duty[i] < lowest) {
+        lowest = pwm->duty[i];
+      }
+    }
+    uint16_t group = 0;
+    for (uint8_t i=0; i<NUM_GPIO; i++) {
+      if ((remaining & (1 << i)) && pwm->duty[i] == lowest) {
+        group |= (1 << i);
+      }
+    }
+    pwm->stepPins[pwm->numSteps] = group;
+    pwm->stepAtNs[pwm->numSteps] = (uint64_t)pwm->periodNs * lowest / PWM_DUTY_MAX;
+    pwm->numSteps++;
+    remaining &= ~group;
+  }
+
+  pwm->step = 0;
+  pwmRunStep(chip);
 }
 
 
 /*
-  All transactions are to be two-bytes long.
-  Anything beyond this, in multiples of two, 
-  simply restarts/overwrites, like a circular 
-  buffer.
+  Register pointer auto-increment.  Transactions work on 
+  register pairs: anything beyond two bytes simply restarts/
+  overwrites the same pair, like a circular buffer (unless 
+  sequential auto-increment is configured).
+  Extension registers are always sequential.
 */
-void incrementPortCount(chip_state_t* chip) {
-  if (chip->i2c_portcount) {
-    // already 1, loop back to zero
-    chip->i2c_portcount = 0;
+void advanceRegPointer(chip_state_t* chip) {
+  if (chip->regPointer >= REG_EXT_BASE) {
+    // extension registers: always sequential, the FIFO is read in place
+    if (chip->regPointer == REG_CNT_LAST) {
+      // a burst wraps around the counters
+      chip->regPointer = REG_CNT_BASE;
+    } else if (chip->regPointer == REG_KP_KEYS7) {
+      // ... and from the key bitmap back to the count and FIFO,
+      // so state and events come in one read
+      chip->regPointer = REG_KP_COUNT;
+    } else if (chip->regPointer != REG_KP_FIFO && chip->regPointer != 0xff) {
+      chip->regPointer++;
+    }
+  } else if (chip->config.sequentialAutoInc) {
+    chip->regPointer = (chip->regPointer + 1) & (NUM_REGS - 1);
   } else {
-    chip->i2c_portcount = 1;
+    chip->regPointer ^= 1;
   }
 }
 
 
+/*
+  Levels the output pins are at: the output register as applied,
+  or wherever the PWM waveform has them.  Key scan pins read as 0.
+*/
+uint16_t outputLevels(const chip_state_t * chip) {
+  uint16_t levels = (chip->appliedOutput & ~chip->pwm.driven) | (chip->pwm.level & chip->pwm.driven);
+  return levels & ~chip->keypad.pins;
+}
+
+/*
+  Snapshot the whole register file as a read starts, so every
+  byte of the read comes from the same instant (both input ports 
+  in particular) and on_i2c_read is just a lookup.  Input bytes
+  show output pins at their output level and are inverted by the
+  polarity register, the interrupt logic tracks the raw input levels.
+*/
+void takeReadSnapshot(chip_state_t * chip) {
+  uint16_t inputs = chip->inputValue;
+  uint16_t polarized = inputPortValue(inputs, outputLevels(chip), chip->inputMask, chip->polarityReg);
+
+  chip->snapshotInputs = inputs;
+  chip->captureSnapshot = chip->captureReg;
+  chip->readSnapshot[REG_INPUT0] = polarized & 0xff;
+  chip->readSnapshot[REG_INPUT1] = polarized >> 8;
+  chip->readSnapshot[REG_OUTPUT0] = chip->outputReg & 0xff;
+  chip->readSnapshot[REG_OUTPUT1] = chip->outputReg >> 8;
+  chip->readSnapshot[REG_POLARITY0] = chip->polarityReg & 0xff;
+  chip->readSnapshot[REG_POLARITY1] = chip->polarityReg >> 8;
+  chip->readSnapshot[REG_CONFIG0] = chip->configReg & 0xff;
+  chip->readSnapshot[REG_CONFIG1] = chip->configReg >> 8;
+
+  if (chip->keypad.pins) {
+    for (uint8_t r=0; r<KEYPAD_MAX_LINES; r++) {
+      chip->keypad.keysSnapshot[r] = chip->keypad.keys[r];
+    }
+  }
+
+  // multi-byte counter reads don't tear: any read that can run
+  // into the counter bank (the key registers wrap before it) gets
+  // them as they are now, counting or not
+  if (chip->regPointer >= REG_INT_ENABLE0 && chip->regPointer <= REG_CNT_LAST) {
+    for (uint8_t i=0; i<NUM_GPIO; i++) {
+      chip->countersSnapshot[i] = chip->counters[i];
+    }
+  }
+}
+
+/*
+  Extension registers.  These are read live, rather than from 
+  the snapshot, as reads can have side effects (the event FIFO
+  and count), apart from the key bitmap.
+*/
+/*
+  Reading a capture byte clears the changes it reported, later 
+  ones stay captured for the next read.
+*/
+uint8_t captureRead(chip_state_t * chip, uint8_t reg) {
+  uint8_t shift = (reg == REG_CAPTURE1) ? 8 : 0;
+  uint8_t value = chip->captureSnapshot >> shift;
+
+  chip->captureReg &= ~((uint16_t)value << shift);
+  if (! interruptPending(chip)) {
+    interruptFlagReadOff(chip);
+  }
+  return value;
+}
+
+uint8_t extRegRead(chip_state_t * chip, uint8_t reg) {
+  keypad_state_t * kp = &(chip->keypad);
+  uint8_t value;
+
+  switch (reg) {
+    case REG_KP_CTRL:
+      return kp->ctrl;
+    case REG_KP_ROWS0:
+      return kp->rowReg & 0xff;
+    case REG_KP_ROWS1:
+      return kp->rowReg >> 8;
+    case REG_KP_COLS0:
+      return kp->colReg & 0xff;
+    case REG_KP_COLS1:
+      return kp->colReg >> 8;
+    case REG_KP_PERIOD:
+      return kp->period;
+    case REG_KP_COUNT:
+      value = keypadEventCount(chip) | (kp->overflow ? KP_COUNT_OVERFLOW : 0);
+      kp->overflow = false;
+      return value;
+    case REG_KP_FIFO:
+      return keypadPopEvent(chip);
+    case REG_INT_ENABLE0:
+      return chip->intEnableReg & 0xff;
+    case REG_INT_ENABLE1:
+      return chip->intEnableReg >> 8;
+    case REG_CAPTURE0:
+    case REG_CAPTURE1:
+      return captureRead(chip, reg);
+    case REG_CAPTURE_CTRL:
+      return chip->captureCtrl;
+    case REG_CNT_RISE0:
+      return chip->countRising & 0xff;
+    case REG_CNT_RISE1:
+      return chip->countRising >> 8;
+    case REG_CNT_FALL0:
+      return chip->countFalling & 0xff;
+    case REG_CNT_FALL1:
+      return chip->countFalling >> 8;
+    case REG_PWM_ENABLE0:
+      return chip->pwm.pins & 0xff;
+    case REG_PWM_ENABLE1:
+      return chip->pwm.pins >> 8;
+    case REG_PWM_PERIOD0:
+      return chip->pwm.periodUs & 0xff;
+    case REG_PWM_PERIOD1:
+      return chip->pwm.periodUs >> 8;
+    default:
+      break;
+  }
+
+  if (reg >= REG_KP_KEYS0 && reg <= REG_KP_KEYS7) {
+    return kp->keysSnapshot[reg - REG_KP_KEYS0];
+  }
+  if (reg >= REG_CNT_BASE && reg <= REG_CNT_LAST) {
+    uint8_t idx = (reg - REG_CNT_BASE) >> 2;
+    return chip->countersSnapshot[idx] >> ((reg & 3) * 8);
+  }
+  if (reg >= REG_PWM_DUTY0 && reg <= REG_PWM_DUTY15) {
+    return chip->pwm.duty[reg - REG_PWM_DUTY0];
+  }
+  return 0;
+}
+
+void extRegWrite(chip_state_t * chip, uint8_t reg, uint8_t data) {
+  keypad_state_t * kp = &(chip->keypad);
+
+  switch (reg) {
+    case REG_KP_CTRL:
+      // (re)applies the row/column setup
+      kp->ctrl = data;
+      keypadRelease(chip);
+      if (data & KP_CTRL_ENABLE) {
+        keypadClaim(chip);
+      }
+      // the waveform hands its pins to the scan, or takes them back,
+      // before its timer runs again
+      if (chip->pwm.pins) {
+        pwmApply(chip);
+      }
+      break;
+    case REG_KP_ROWS0:
+      kp->rowReg = (kp->rowReg & 0xff00) | data;
+      break;
+    case REG_KP_ROWS1:
+      kp->rowReg = (kp->rowReg & 0x00ff) | (data << 8);
+      break;
+    case REG_KP_COLS0:
+      kp->colReg = (kp->colReg & 0xff00) | data;
+      break;
+    case REG_KP_COLS1:
+      kp->colReg = (kp->colReg & 0x00ff) | (data << 8);
+      break;
+    case REG_KP_PERIOD:
+      kp->period = data;
+      break;
+    case REG_INT_ENABLE0:
+    case REG_INT_ENABLE1:
+      chip->intEnableReg = (reg == REG_INT_ENABLE0) 
+                              ? ((chip->intEnableReg & 0xff00) | data)
+                              : ((chip->intEnableReg & 0x00ff) | (data << 8));
+      // newly enabled pins may have changes waiting, disabled ones release
+      interruptUpdate(chip);
+      break;
+    case REG_CAPTURE_CTRL:
+      chip->captureCtrl = data;
+      interruptUpdate(chip);
+      break;
+    case REG_CNT_RISE0:
+      chip->countRising = (chip->countRising & 0xff00) | data;
+      break;
+    case REG_CNT_RISE1:
+      chip->countRising = (chip->countRising & 0x00ff) | (data << 8);
+      break;
+    case REG_CNT_FALL0:
+      chip->countFalling = (chip->countFalling & 0xff00) | data;
+      break;
+    case REG_CNT_FALL1:
+      chip->countFalling = (chip->countFalling & 0x00ff) | (data << 8);
+      break;
+    case REG_CNT_CLEAR0:
+    case REG_CNT_CLEAR1:
+      for (uint8_t i=0; i<8; i++) {
+        if (data & (1 << i)) {
+          chip->counters[(reg == REG_CNT_CLEAR1) ? i + 8 : i] = 0;
+        }
+      }
+      break;
+    case REG_PWM_ENABLE0:
+      chip->pwm.pins = (chip->pwm.pins & 0xff00) | data;
+      chip->pwm.pending = true;
+      break;
+    case REG_PWM_ENABLE1:
+      chip->pwm.pins = (chip->pwm.pins & 0x00ff) | (data << 8);
+      chip->pwm.pending = true;
+      break;
+    case REG_PWM_PERIOD0:
+      chip->pwm.periodUs = (chip->pwm.periodUs & 0xff00) | data;
+      chip->pwm.pending = true;
+      break;
+    case REG_PWM_PERIOD1:
+      chip->pwm.periodUs = (chip->pwm.periodUs & 0x00ff) | (data << 8);
+      chip->pwm.pending = true;
+      break;
+    default:
+      if (reg >= REG_PWM_DUTY0 && reg <= REG_PWM_DUTY15) {
+        // the whole write applies as one, at the end of the transaction
+        chip->pwm.duty[reg - REG_PWM_DUTY0] = data;
+        chip->pwm.pending = true;
+      }
+      // otherwise read-only, or nothing there
+      break;
+  }
+}
+
 /*
   I2C connection callback.
   Will tell up the device address and whether this is a read or write 
   operation
 */
 bool on_i2c_connect(void *user_data, uint32_t address, bool read) {
+  HOST_CONTEXT(HOSTCTX_I2C_CONNECT);
   // `address` parameter contains the 7-bit address that was received on the I2C bus.
   // `read` indicates whether this is a read request (true) or write request (false).
   CHIPSTATE_FROM(user_data);
+  TRACE(TRACE_EV_I2C_CONNECT, chip, read, address);
 
   if (address != chip->address) {
-    printf("Getting connects for address 0x%x but am at 0x%x\n", address, chip->address);
+    CHIP_LOG_WARN(chip, LOGEV_ADDR_MISMATCH, address, chip->address);
     // return true;
   }
 
-  // a new connection
-  chip->i2c_portcount = 0;
+  // a repeated start ends the write that came before it
+  if (chip->stagedPending) {
+    commitPinConfig(chip);
+  }
+  if (chip->pwm.pending) {
+    pwmApply(chip);
+  }
+
+  // a new connection.  Reads carry on from wherever the 
+  // register pointer was left, writes start with a command byte
+  chip->pairWriteCount = 0;
+  if (! read) {
+    chip->expectCommand = true;
+  } else if (chip->config.pollInputs) {
+    // nothing is watched, sample the inputs for this read
+    pollSampleInputs(chip);
+  }
+
+  if (read) {
+    takeReadSnapshot(chip);
+  }
+  return true; // true means ACK, false NACK
+}
+
+/*
+  Reading a register as a single byte, from the snapshot.
+  Reading an input port is what resets the 
+  interrupt flag, based on exactly what was returned.
+*/
+uint8_t on_i2c_read(void *user_data) {
+  HOST_CONTEXT(HOSTCTX_I2C_READ);
+  CHIPSTATE_FROM(user_data);
+  uint8_t reg = chip->regPointer;
+  uint8_t retVal = (reg < NUM_REGS) ? chip->readSnapshot[reg] : extRegRead(chip, reg);
+
+  if (reg <= REG_INPUT1) {
+    uint16_t portMask = 0xff << ((reg & 1) * 8);
+    chip->lastReadValue = (chip->lastReadValue & ~portMask) | (chip->snapshotInputs & portMask);
+    if (! interruptPending(chip)) {
+      CHIP_LOG_DEBUG(chip, LOGEV_INT_RESET_ON_READ, 0, 0);
+      interruptFlagReadOff(chip);
+    }
+  }
+
+  advanceRegPointer(chip);
+  TRACE(TRACE_EV_I2C_READ, chip, 0, retVal);
+
+  return retVal; // The byte to be returned to the microcontroller
+}
+
+
+/*
+  What a pin should be doing for a given direction/output level
+   * input: input, with pull-up if the variant has them (and watched)
+   * output LOW: tied to GND
+   * output HIGH: released and pulled up, or driven (push-pull)
+*/
+uint32_t pinModeFor(const chip_state_t * chip, bool isInput, bool level) {
+  if (isInput) {
+    return chip->inputPinMode;
+  }
+  if (level) {
+    return chip->outputHighMode;
+  }
+  return OUTPUT_LOW;
+}
+
+/*
+  Apply the staged output/config registers to the pins.
+  Only pins whose direction, or output level, actually changed 
+  (old XOR new) are touched, so rewriting the same config is free.
+*/
+void commitPinConfig(chip_state_t* chip) {
+  // pins owned by the key scan are left alone until it releases them
+  uint16_t effectiveConfig = chip->configReg & ~chip->keypad.pins;
+  uint16_t dirChanged = (chip->inputMask ^ chip->configReg) & ~chip->keypad.pins;
+  uint16_t levelChanged = (chip->appliedOutput ^ chip->outputReg) & ~chip->configReg & ~chip->keypad.pins & ~chip->pwm.driven;
+  uint16_t changed = dirChanged | levelChanged;
+  uint16_t newInputs = dirChanged & chip->configReg;
+
+  chip->stagedPending = false;
+  if (! changed) {
+    return;
+  }
+
+  // our own mode changes (a pin released to its pull-up, an output
+  // looped back onto an input) can call straight back into
+  // chip_input_io_change, hold those until the batch is done
+  chip->reconfiguring = true;
+  chip->reconfigEdges = 0;
+
+  for (uint8_t i=0; i<NUM_GPIO; i++) {
+    uint16_t bit = (1 << i);
+    if (! (changed & bit)) {
+      continue;
+    }
+
+    // shortcut to the i/o pin we're processing
+    pin_t targetPin = chip->io[i];
+    // a PWM pin is wherever the waveform left it, not at its register level
+    uint16_t oldLevel = (chip->pwm.driven & bit) ? chip->pwm.level : chip->appliedOutput;
+    uint32_t oldMode = pinModeFor(chip, chip->inputMask & bit, oldLevel & bit);
+    uint32_t newMode = pinModeFor(chip, chip->configReg & bit, chip->outputReg & bit);
+
+    if ((dirChanged & bit) && ! (chip->configReg & bit) && ! chip->config.pollInputs) {
+      // no longer an input, stop watching
+      hostPinWatchStop(targetPin);
+    }
+
+    if (oldMode != newMode) {
+      hostPinMode(targetPin, newMode);
+    }
+
+    if ((newInputs & bit) && ! chip->config.pollInputs) {
+      hostPinWatch(targetPin, &(chip->io_watch_config));
+    }
+  }
+
+  displayMarkDirty(chip, changed);
+  if (dirChanged) {
+    TRACE(TRACE_EV_DIRECTION, chip, 0, chip->configReg);
+  }
+  if (chip->appliedOutput != chip->outputReg) {
+    TRACE(TRACE_EV_OUTPUT, chip, 0, chip->outputReg);
+  }
+
+  chip->inputMask = effectiveConfig;
+  chip->appliedOutput = chip->outputReg;
+
+  // resync the cached inputs: outputs drop out and only the 
+  // pins that just became inputs, or saw an edge during the 
+  // batch, need a read
+  uint16_t edges = chip->reconfigEdges & chip->inputMask;
+  uint16_t resync = newInputs | edges;
+  chip->inputValue &= chip->inputMask & ~resync;
+  for (uint8_t i=0; i<NUM_GPIO; i++) {
+    if ((resync & (1 << i)) && hostPinRead(chip->io[i])) {
+      chip->inputValue |= (1 << i);
+    }
+  }
+  chip->reconfiguring = false;
 
-  // printf("i2c connect for ");
-  if (read) {
-    printf("Read: reset INT flag\n");
-    chip->lastReadValue = chip->inputValue;
-    interruptFlagOff(chip);
-  } 
-  return true; // true means ACK, false NACK
-}
+  // a direction change isn't an input change: pins that just became
+  // inputs start out as read, outputs drop out of the comparison
+  chip->lastReadValue = (chip->lastReadValue & ~dirChanged) | (chip->inputValue & dirChanged);
 
-/*
-  Reading a port as a single byte.
-*/
-uint8_t on_i2c_read(void *user_data) {
-  // printf("i2c Read\n");
+  CHIP_LOG_DEBUG(chip, LOGEV_INPUT_MASK, chip->inputMask, 0);
 
-  CHIPSTATE_FROM(user_data);
-  uint8_t retVal = (chip->inputValue >> (chip->i2c_portcount*8)) & 0xff;
-  
-  incrementPortCount(chip);
+  // one nINT decision for whatever the held edges and the new
+  // directions added up to
+  if (edges) {
+    displayMarkDirty(chip, edges);
+    evaluateInputs(chip);
+  } else if (dirChanged) {
+    interruptUpdate(chip);
+  }
 
-  return retVal; // The byte to be returned to the microcontroller
+  // PWM pins that changed direction join or leave the waveform
+  if (dirChanged & chip->pwm.pins) {
+    pwmApply(chip);
+  }
 }
 
 /*
-  Writing to a port configures the pins as either
-   * output LOW
-   * output HIGH / Input (with pull-up)
+  Writing: the first byte is the command, selecting the register,
+  the following are data for that register (and its pair partner).
+  Output and config writes are only staged here, pins get 
+  reconfigured once both registers of a pair have been written.
 */
 bool on_i2c_write(void *user_data, uint8_t data) {
+  HOST_CONTEXT(HOSTCTX_I2C_WRITE);
   // `data` is the byte received from the microcontroller
   CHIPSTATE_FROM(user_data);
+  TRACE(TRACE_EV_I2C_WRITE, chip, 0, data);
 
-  if (! chip->i2c_portcount) {
-
-    // we are getting bytes, 
-    // and this is the first of the 
-    // two (or multiples of 2) ports.
-    // so reset our input tracking mask
-    chip->inputMask = 0;
+  if (chip->expectCommand) {
+    chip->expectCommand = false;
+    chip->regPointer = (data >= REG_EXT_BASE) ? data : (data & (NUM_REGS - 1));
+    return true;
   }
 
-  for (uint8_t i=0; i<8; i++) {
-
-    // we want our 16-bit index, calculated from 
-    // both the bit of this particular byte and accounting
-    // for if this is the first or second of the bytes written
-    uint8_t bitIdx = i + (chip->i2c_portcount * 8);
-
-    // shortcut to the i/o pin we're processing
-    pin_t targetPin = chip->io[bitIdx];
-
-    // disable any watch setup for this pin
-    pin_watch_stop(targetPin);
-
-    if (data & (1<<i)) {
-      // this is a HIGH/read
-      // note it in inputMask, setup up as input with pull-up and watch
-      chip->inputMask |= (1 << bitIdx);
-      pin_mode(targetPin, INPUT_PULLUP);
-      pin_watch(targetPin, &(chip->io_watch_config));
-    } else {
-      
-      // configured as output, tied to GND (low)
-      pin_mode(targetPin, OUTPUT_LOW);
-    }
-
+  uint8_t reg = chip->regPointer;
+  if (reg >= REG_EXT_BASE) {
+    extRegWrite(chip, reg, data);
+    advanceRegPointer(chip);
+    return true;
+  }
 
+  uint8_t shift = (reg & 1) * 8;
+  uint16_t keep = ~(0xff << shift);
+
+  switch (reg & ~1) {
+    case REG_INPUT0:
+      // read-only, writes have no effect
+      break;
+    case REG_OUTPUT0:
+      chip->outputReg = (chip->outputReg & keep) | (data << shift);
+      chip->stagedPending = true;
+      break;
+    case REG_POLARITY0:
+      chip->polarityReg = (chip->polarityReg & keep) | (data << shift);
+      break;
+    default:
+      chip->configReg = (chip->configReg & keep) | (data << shift);
+      chip->stagedPending = true;
+      break;
   }
 
+  advanceRegPointer(chip);
 
-  if (chip->i2c_portcount) {
+  if (++chip->pairWriteCount >= 2) {
     // we just got the last of a set-of-two bytes
-    printf("Input mask is now 0x%x\n", chip->inputMask);
+    chip->pairWriteCount = 0;
+    if (chip->stagedPending && ! chip->config.commitOnStop) {
+      commitPinConfig(chip);
+    }
   }
 
-  // get ready for next byte written by incrementing port counter
-  incrementPortCount(chip);
-
   return true; // true means ACK, false NACK
 }
 
 
 
 void on_i2c_disconnect(void *user_data) {
+  HOST_CONTEXT(HOSTCTX_I2C_DISCONNECT);
+  CHIPSTATE_FROM(user_data);
+  TRACE(TRACE_EV_I2C_DISCONNECT, chip, 0, 0);
 
-  // This method is optional. Useful if you need to know when the I2C transaction has concluded.
+  // transaction ended part-way through a pair (or everything 
+  // was held for the STOP), apply whatever we got
+  if (chip->stagedPending) {
+    commitPinConfig(chip);
+  }
+  if (chip->pwm.pending) {
+    pwmApply(chip);
+  }
 }
 
 
@@ -193,33 +1843,56 @@ void on_i2c_disconnect(void *user_data) {
   simply be handled there.
 */
 uint8_t read_address(chip_state_t* chip) {
-  uint8_t configuredAddress = I2C_BASE_ADDRESS;
+  uint8_t configuredAddress = chip->variant->baseAddress;
   uint8_t lsbits = 0;
   
-  for (uint8_t i=0; i<NUM_ADDR_BITS; i++) {
-    if (pin_read(chip->addressBits[i])) {
+  for (uint8_t i=0; i<chip->variant->numAddrBits; i++) {
+    if (hostPinRead(chip->addressBits[i])) {
       lsbits |= (1 << i);
     }
   }
 
   configuredAddress = configuredAddress | lsbits;
 
-  printf("Chip LSB bits set to %i.  Address is 0x%02x\n", lsbits, configuredAddress);
+  CHIP_LOG_INFO(chip, LOGEV_ADDRESS, lsbits, configuredAddress);
 
   return configuredAddress;
 }
 
 
 void chip_addr_change(void *user_data, pin_t pin, uint32_t value) {
+  HOST_CONTEXT(HOSTCTX_ADDR_CHANGE);
   CHIPSTATE_FROM(user_data);
   chip->address = read_address(chip);
 }
 
 
 
+/*
+  Map a pin handle, as received in watch callbacks, back to 
+  its 16-bit io index.  Returns PIN_NOT_IO for anything that 
+  isn't one of the P0x/P1x pins.
+*/
+uint8_t ioBitIndex(chip_state_t * chip, pin_t pin) {
+  if (pin >= 0 && pin < PIN_LOOKUP_SIZE) {
+    return chip->ioBitFromPin[pin];
+  }
+
+  // unusually large pin id, fall back to a search
+  for (uint8_t i=0; i<NUM_GPIO; i++) {
+    if (chip->io[i] == pin) {
+      return i;
+    }
+  }
+  return PIN_NOT_IO;
+}
+
+
 /* 
   Read the value of the combined input pins, skipping over 
-  any that have been configured as output (LOW)
+  any that have been configured as output (LOW).
+  This is a full rescan, costing a pin_read per input, so 
+  is only used to resync inputValue after (re)configuration.
 */
 uint16_t readInputsValue(chip_state_t * chip) {
   uint16_t inputsValue = 0;
@@ -227,7 +1900,7 @@ uint16_t readInputsValue(chip_state_t * chip) {
     if (chip->inputMask & (1 << i)) {
       // this is an input, we must read
       
-      if (pin_read(chip->io[i])) {
+      if (hostPinRead(chip->io[i])) {
           inputsValue |= (1<<i);
       }
     }
@@ -237,34 +1910,242 @@ uint16_t readInputsValue(chip_state_t * chip) {
 
 
 /*
-  Anything that _may_ be treated as an output is watched and,
-  on changes, this callback is triggered.
   If the value read in is different than that provided to user
   on last read, we will set the interrupt flag.
   If it is the same, we _clear_ the interrupt flag--this means
   that some changes may be missed by user... yap, but that's 
-  how the chip works.
+  how the chip works.  Unread key events keep it asserted, inputs
+  with their interrupt enable bit cleared never raise it.
+  Only for input changes (edges, rescans, polled samples), which 
+  the folded/lost statistics are about.
 */
-void chip_input_io_change(void *user_data, pin_t pin, uint32_t value) {
-
-  CHIPSTATE_FROM(user_data);
-  
-  chip->inputValue = readInputsValue(chip);
+void evaluateInputs(chip_state_t * chip) {
+  // rescans and polled samples are captured here, edges as they arrive
+  chip->captureReg |= (chip->inputValue ^ chip->lastReadValue) & chip->inputMask;
 
-  if (chip->inputValue != chip->lastReadValue) {
+  if (interruptPending(chip)) {
+    if (chip->intAsserted) {
+      INT_STAT_COUNT(chip, INTSTAT_FOLDED);
+    }
     interruptFlagOn(chip);
   } else {
+    if (chip->intAsserted) {
+      INT_STAT_COUNT(chip, INTSTAT_LOST);
+    }
     interruptFlagOff(chip);
   }
 
+  CHIP_LOG_DEBUG(chip, LOGEV_INPUT_CHANGED, chip->lastReadValue, chip->inputValue);
+}
 
-  printf("I/O input changed:");
-  PRINTF_INPUTVALUE("from", chip->lastReadValue);
-  PRINTF_INPUTVALUE("to", chip->inputValue);
-  printf("\n");
-  
+/*
+  Coalescing window elapsed, settle on whatever 
+  the inputs look like now.
+*/
+void chip_coalesce_timer_done(void *user_data) {
+  HOST_CONTEXT(HOSTCTX_TIMER);
+  CHIPSTATE_FROM(user_data);
+  chip->evaluationPending = false;
+  evaluateInputs(chip);
+}
+
+/*
+  Poll mode: sample everything, with whatever changed since the
+  last sample captured, as the watch callback would have.
+*/
+void pollSampleInputs(chip_state_t * chip) {
+  uint16_t sampled = readInputsValue(chip);
+  uint16_t changed = sampled ^ chip->inputValue;
+  displayMarkDirty(chip, changed);
+  chip->captureReg |= changed;
+  chip->inputValue = sampled;
+}
+
+/*
+  Poll mode timer: sample and decide on nINT, in place of 
+  per-edge watch callbacks.
+*/
+void chip_poll_timer_done(void *user_data) {
+  HOST_CONTEXT(HOSTCTX_TIMER);
+  CHIPSTATE_FROM(user_data);
+  pollSampleInputs(chip);
+  evaluateInputs(chip);
+}
+
+/*
+  Anything that _may_ be treated as an output is watched and,
+  on changes, this callback is triggered.
+  The callback hands us the pin and its new value, so inputValue
+  is updated one bit at a time rather than re-reading every input.
+  With coalescing on, the interrupt decision waits for the 
+  window to elapse, so all edges within it count as one change.
+  Every edge is also captured (REG_CAPTURE), so a pulse that is 
+  back to its old level before the firmware reads still shows.
+*/
+void chip_input_io_change(void *user_data, pin_t pin, uint32_t value) {
+  HOST_CONTEXT(HOSTCTX_INPUT_CHANGE);
+
+  CHIPSTATE_FROM(user_data);
+
+  uint8_t bitIdx = ioBitIndex(chip, pin);
+  TRACE(TRACE_EV_PIN_EDGE, chip, bitIdx, value);
+  if (chip->reconfiguring) {
+    // mid-commit, commitPinConfig resyncs these when it's done
+    chip->reconfigEdges |= (bitIdx == PIN_NOT_IO) ? 0xffff : (1 << bitIdx);
+    return;
+  }
+  if (bitIdx == PIN_NOT_IO) {
+    // not something we know about, resync everything
+    chip->inputValue = readInputsValue(chip);
+  } else if (chip->inputMask & (1 << bitIdx)) {
+    if (value) {
+      chip->inputValue |= (1 << bitIdx);
+    } else {
+      chip->inputValue &= ~(1 << bitIdx);
+    }
+    // every edge counts, coalesced or not
+    if ((value ? chip->countRising : chip->countFalling) & (1 << bitIdx)) {
+      chip->counters[bitIdx]++;
+    }
+    chip->captureReg |= (1 << bitIdx);
+    displayMarkDirty(chip, 1 << bitIdx);
+  }
+
+  if (chip->config.coalesceWindowNs) {
+    if (! chip->evaluationPending) {
+      chip->evaluationPending = true;
+      hostTimerStartNs(chip->coalesceTimer, chip->config.coalesceWindowNs, false);
+    }
+    return;
+  }
+
+  evaluateInputs(chip);
+}
+
+/* PCF8575 variant
+  No command byte or registers: writes set all 16 quasi-bidirectional 
+  pins, two bytes at a time (1 = weak high, usable as input, 0 = driven
+  low), reads return the pin levels.  Any read resets the interrupt.
+  Writes map straight onto the output/config registers, so the same
+  diff-based commit applies.
+*/
+bool on_pcf8575_i2c_connect(void *user_data, uint32_t address, bool read) {
+  HOST_CONTEXT(HOSTCTX_I2C_CONNECT);
+  CHIPSTATE_FROM(user_data);
+  TRACE(TRACE_EV_I2C_CONNECT, chip, read, address);
+
+  if (chip->stagedPending) {
+    commitPinConfig(chip);
+  }
+
+  // the port counter
+  chip->regPointer = 0;
+  chip->pairWriteCount = 0;
+
+  if (read) {
+    if (chip->config.pollInputs) {
+      pollSampleInputs(chip);
+    }
+    chip->snapshotInputs = chip->inputValue;
+    chip->readSnapshot[0] = chip->inputValue & 0xff;
+    chip->readSnapshot[1] = chip->inputValue >> 8;
+
+    CHIP_LOG_DEBUG(chip, LOGEV_INT_RESET_ON_READ, 0, 0);
+    chip->lastReadValue = chip->inputValue;
+    interruptFlagReadOff(chip);
+  }
+  return true; // true means ACK, false NACK
+}
+
+uint8_t on_pcf8575_i2c_read(void *user_data) {
+  HOST_CONTEXT(HOSTCTX_I2C_READ);
+  CHIPSTATE_FROM(user_data);
+  uint8_t retVal = chip->readSnapshot[chip->regPointer];
+
+  chip->regPointer ^= 1;
+  TRACE(TRACE_EV_I2C_READ, chip, 0, retVal);
+
+  return retVal; // The byte to be returned to the microcontroller
+}
+
+bool on_pcf8575_i2c_write(void *user_data, uint8_t data) {
+  HOST_CONTEXT(HOSTCTX_I2C_WRITE);
+  CHIPSTATE_FROM(user_data);
+  TRACE(TRACE_EV_I2C_WRITE, chip, 0, data);
+
+  uint8_t shift = chip->regPointer * 8;
+  uint16_t keep = ~(0xff << shift);
+
+  chip->outputReg = (chip->outputReg & keep) | (data << shift);
+  chip->configReg = chip->outputReg;
+  chip->stagedPending = true;
+  chip->regPointer ^= 1;
+
+  if (++chip->pairWriteCount >= 2) {
+    // we just got the last of a set-of-two bytes
+    chip->pairWriteCount = 0;
+    if (! chip->config.commitOnStop) {
+      commitPinConfig(chip);
+    }
+  }
+
+  return true; // true means ACK, false NACK
 }
 
+
+/*
+  Per-variant behaviour and callbacks
+*/
+static const chip_variant_t chipVariants[NUM_VARIANTS] = {
+  [VARIANT_PCA9535] = {
+    .name = "PCA9535",
+    .baseAddress = I2C_BASE_ADDRESS,
+    .numAddrBits = 3,
+    .inputPinMode = INPUT,
+    .connect = on_i2c_connect,
+    .read = on_i2c_read,
+    .write = on_i2c_write,
+    .disconnect = on_i2c_disconnect,
+    .pin_change = chip_input_io_change,
+  },
+  [VARIANT_PCA9555] = {
+    // same as the PCA9535, plus internal pull-ups on inputs
+    .name = "PCA9555",
+    .baseAddress = I2C_BASE_ADDRESS,
+    .numAddrBits = 3,
+    .inputPinMode = INPUT_PULLUP,
+    .connect = on_i2c_connect,
+    .read = on_i2c_read,
+    .write = on_i2c_write,
+    .disconnect = on_i2c_disconnect,
+    .pin_change = chip_input_io_change,
+  },
+  [VARIANT_TCA6416] = {
+    // same register map, single ADDR pin (on A0)
+    .name = "TCA6416",
+    .baseAddress = I2C_BASE_ADDRESS,
+    .numAddrBits = 1,
+    .inputPinMode = INPUT,
+    .connect = on_i2c_connect,
+    .read = on_i2c_read,
+    .write = on_i2c_write,
+    .disconnect = on_i2c_disconnect,
+    .pin_change = chip_input_io_change,
+  },
+  [VARIANT_PCF8575] = {
+    .name = "PCF8575",
+    .baseAddress = I2C_BASE_ADDRESS,
+    .numAddrBits = 3,
+    .inputPinMode = INPUT_PULLUP,
+    .quasiBidirectional = true,
+    .connect = on_pcf8575_i2c_connect,
+    .read = on_pcf8575_i2c_read,
+    .write = on_pcf8575_i2c_write,
+    .disconnect = on_i2c_disconnect,
+    .pin_change = chip_input_io_change,
+  },
+};
+
 /*
   The chip_state_t structure is initialized here.
   Could do this in chip_init, but there are lots of values
@@ -272,25 +2153,78 @@ void chip_input_io_change(void *user_data, pin_t pin, uint32_t value) {
 */
 void initialize_state(chip_state_t * chip) {
 
-  chip->address = I2C_BASE_ADDRESS;
+  chip->variant = &(chipVariants[chip->config.variant]);
+  chip->inputPinMode = chip->variant->inputPinMode;
+  chip->outputHighMode = (chip->config.pushPull && ! chip->variant->quasiBidirectional) ? OUTPUT_HIGH : INPUT_PULLUP;
+
+  chip->address = chip->variant->baseAddress;
   chip->inputMask = 0xffff;
   chip->inputValue = 0xffff;
-  
-  chip->i2c_portcount = 0;
+  chip->lastReadValue = 0xffff;
+  chip->appliedOutput = 0xffff;
+
+  // power-on register defaults
+  chip->outputReg = 0xffff;
+  chip->polarityReg = 0;
+  chip->configReg = 0xffff;
+  chip->stagedPending = false;
+  chip->reconfiguring = false;
+  chip->reconfigEdges = 0;
+  chip->intEnableReg = 0xffff;
+  chip->captureReg = 0;
+  chip->captureSnapshot = 0;
+  chip->captureCtrl = 0;
+  chip->countRising = 0;
+  chip->countFalling = 0;
+  for (uint8_t i=0; i<NUM_GPIO; i++) {
+    chip->counters[i] = 0;
+  }
+
+  chip->regPointer = REG_INPUT0;
+  chip->expectCommand = false;
+  chip->pairWriteCount = 0;
 
   chip->io_watch_config.edge = BOTH;
-  chip->io_watch_config.pin_change = chip_input_io_change;
+  chip->io_watch_config.pin_change = chip->variant->pin_change;
   chip->io_watch_config.user_data = chip;
 
+  chip->evaluationPending = false;
+  const timer_config_t coalesce_timer_config = {
+    .callback = chip_coalesce_timer_done,
+    .user_data = chip,
+  };
+  chip->coalesceTimer = hostTimerInit(&coalesce_timer_config);
+
+  const timer_config_t keypad_timer_config = {
+    .callback = chip_keypad_timer_done,
+    .user_data = chip,
+  };
+  chip->keypad.timer = hostTimerInit(&keypad_timer_config);
+
+  chip->pwm.pins = 0;
+  chip->pwm.periodUs = 0;
+  chip->pwm.pending = false;
+  chip->pwm.driven = 0;
+  chip->pwm.level = 0;
+  chip->pwm.numSteps = 0;
+  for (uint8_t i=0; i<NUM_GPIO; i++) {
+    chip->pwm.duty[i] = 0;
+  }
+
+  const timer_config_t pwm_timer_config = {
+    .callback = chip_pwm_timer_done,
+    .user_data = chip,
+  };
+  chip->pwm.timer = hostTimerInit(&pwm_timer_config);
 
   i2c_config_t * i2c = &(chip->i2c_config);
-  i2c->scl = pin_init("SCL", INPUT_PULLUP);
-  i2c->sda = pin_init("SDA", INPUT_PULLUP);
+  i2c->scl = hostPinInit("SCL", INPUT_PULLUP);
+  i2c->sda = hostPinInit("SDA", INPUT_PULLUP);
   
-  i2c->connect = on_i2c_connect;
-  i2c->read = on_i2c_read;
-  i2c->write = on_i2c_write;
-  i2c->disconnect = on_i2c_disconnect;
+  i2c->connect = chip->variant->connect;
+  i2c->read = chip->variant->read;
+  i2c->write = chip->variant->write;
+  i2c->disconnect = chip->variant->disconnect;
 
   i2c->user_data = chip;
 
@@ -299,21 +2233,44 @@ void initialize_state(chip_state_t * chip) {
 
 }
 
+bool stateFromAttr(chip_state_t * chip, bool * intAsserted);
+void generalCallInit(chip_state_t * chip);
+
 /*
   Chip initialization, called on startup.
+  With a saved state in the "state" attribute, pins are created
+  straight in their saved direction/level and only inputs watched.
 */
 void chip_init() {
-  chip_state_t *chip = malloc(sizeof(chip_state_t));
   const char * addrPinNames[] = {"A0", "A1", "A2"};
   const char * ioPinNames[] = {
         "P00", "P01", "P02", "P03", "P04", "P05", "P06", "P07",
         "P10", "P11", "P12", "P13", "P14", "P15", "P16", "P17"};
 
 
+  if (! chipNumInstances()) {
+    // shared by all instances
+    hostStatsInit();
+    logInit(logFormats);
+    traceInit();
+  }
+
+  chip_state_t *chip = chipAlloc();
+  if (! chip) {
+    LOG_ERROR(LOGEV_POOL_EXHAUSTED, CHIP_MAX_INSTANCES, 0);
+    return;
+  }
+
+  // per-instance behaviour, from the diagram attributes
+  loadConfig(&(chip->config));
+
   // basic state setup 
   initialize_state(chip);
 
-  chip->nINT = pin_init("nINT", INPUT);
+  bool savedInt = false;
+  bool restored = stateFromAttr(chip, &savedInt);
+
+  chip->nINT = hostPinInit("nINT", INPUT);
 
 
   // address pins monitoring
@@ -324,28 +2281,436 @@ void chip_init() {
   };
 
   for (uint8_t i=0; i<NUM_ADDR_BITS; i++) {
-    chip->addressBits[i] = pin_init(addrPinNames[i], INPUT); 
+    // unused address pins (TCA6416) are still claimed, just never read
+    chip->addressBits[i] = hostPinInit(addrPinNames[i], INPUT); 
 
-    pin_watch(chip->addressBits[i], &watch_addr_config);
+    hostPinWatch(chip->addressBits[i], &watch_addr_config);
   }
 
   
+  for (uint8_t i=0; i<PIN_LOOKUP_SIZE; i++) {
+    chip->ioBitFromPin[i] = PIN_NOT_IO;
+  }
+
   for (uint8_t i=0; i<NUM_GPIO; i++) {
-    chip->io[i] = pin_init(ioPinNames[i], INPUT_PULLUP); // on power up, high/input
-    pin_watch(chip->io[i], &(chip->io_watch_config));
+    // on power up all inputs, unless restoring a saved state
+    bool isInput = chip->configReg & (1 << i);
+    chip->io[i] = hostPinInit(ioPinNames[i], pinModeFor(chip, isInput, chip->outputReg & (1 << i)));
+    if (chip->io[i] >= 0 && chip->io[i] < PIN_LOOKUP_SIZE) {
+      chip->ioBitFromPin[chip->io[i]] = i;
+    }
+    if (isInput && ! chip->config.pollInputs) {
+      hostPinWatch(chip->io[i], &(chip->io_watch_config));
+    }
+  }
+  chip->inputMask = chip->configReg;
+  chip->appliedOutput = chip->outputReg;
+  chip->inputValue = readInputsValue(chip);
+  if (! restored) {
+    chip->lastReadValue = chip->inputValue;
   }
-  chip->inputMask = 0xffff;
 
   chip->address = read_address(chip);
   chip->i2c_config.address = chip->address;
-  chip->i2c_dev =  i2c_init(&(chip->i2c_config));
+  chip->i2c_dev = hostI2cInit(&(chip->i2c_config));
+
+  CHIP_LOG_INFO(chip, LOGEV_I2C_INIT, chip->address, chip->config.variant);
+  if (chip->instanceIdx == 0) {
+    generalCallInit(chip);
+  }
+
+  displayInit(chip);
+  if (savedInt) {
+    interruptFlagOn(chip);
+  } else {
+    interruptFlagOff(chip);
+  }
+
+  if (chip->keypad.ctrl & KP_CTRL_ENABLE) {
+    keypadClaim(chip);
+  }
+  if (chip->pwm.pins) {
+    pwmApply(chip);
+  }
+
+  if (chip->config.pollInputs && ! chip->config.pollIntervalUs) {
+    // nothing samples the inputs between reads
+    CHIP_LOG_WARN(chip, LOGEV_POLL_NO_INT, chip->instanceIdx, 0);
+  }
+  if (chip->config.pollInputs && chip->config.pollIntervalUs) {
+    const timer_config_t poll_timer_config = {
+      .callback = chip_poll_timer_done,
+      .user_data = chip,
+    };
+    chip->pollTimer = hostTimerInit(&poll_timer_config);
+    hostTimerStart(chip->pollTimer, chip->config.pollIntervalUs, true);
+  }
+}
+
+
+
+/* State snapshot and restore
+  The register file and the bits of i2c/interrupt state behind it, 
+  as a small versioned blob (little endian):
+    0   uint16  STATE_MAGIC
+    2   uint8   STATE_VERSION
+    3   uint8   variant
+    4   uint8   flags (STATE_FLAG_*)
+    5   uint8   register pointer / port counter
+    6   uint16  output, polarity, config registers
+    12  uint16  inputs as last read by the firmware
+    14  uint8   key scan control, period
+    16  uint16  key scan rows, columns
+    20  uint16  interrupt enable
+    22  uint16  counted rising, falling edges
+    26  uint16  PWM enable, period
+    30  uint8   PWM duty, x16
+    46  uint8   change capture control
+  Pin levels, counts and captured changes are not part of it, 
+  inputs are whatever the simulation is driving them to.  The host saves/restores 
+  through a buffer in the chip's memory, or hands a saved 
+  state over in the "state" attribute as hex.
+*/
+#define STATE_MAGIC    0x9535
+#define STATE_VERSION  3
+#define STATE_SIZE     47
+
+#define STATE_FLAG_INT             0x01
+#define STATE_FLAG_EXPECT_COMMAND  0x02
+#define STATE_FLAG_PAIR_HALF       0x04
+
+static uint8_t stateBuffer[STATE_SIZE];
+
+void statePut16(uint8_t * out, uint16_t value) {
+  out[0] = value & 0xff;
+  out[1] = value >> 8;
+}
+
+uint16_t stateGet16(const uint8_t * in) {
+  return in[0] | (in[1] << 8);
+}
+
+uint32_t stateEncode(const chip_state_t * chip, uint8_t * out) {
+  statePut16(&out[0], STATE_MAGIC);
+  out[2] = STATE_VERSION;
+  out[3] = chip->config.variant;
+  out[4] = (chip->intAsserted ? STATE_FLAG_INT : 0)
+            | (chip->expectCommand ? STATE_FLAG_EXPECT_COMMAND : 0)
+            | (chip->pairWriteCount ? STATE_FLAG_PAIR_HALF : 0);
+  out[5] = chip->regPointer;
+  statePut16(&out[6], chip->outputReg);
+  statePut16(&out[8], chip->polarityReg);
+  statePut16(&out[10], chip->configReg);
+  statePut16(&out[12], chip->lastReadValue);
+  out[14] = chip->keypad.ctrl;
+  out[15] = chip->keypad.period;
+  statePut16(&out[16], chip->keypad.rowReg);
+  statePut16(&out[18], chip->keypad.colReg);
+  statePut16(&out[20], chip->intEnableReg);
+  statePut16(&out[22], chip->countRising);
+  statePut16(&out[24], chip->countFalling);
+  statePut16(&out[26], chip->pwm.pins);
+  statePut16(&out[28], chip->pwm.periodUs);
+  for (uint8_t i=0; i<NUM_GPIO; i++) {
+    out[30 + i] = chip->pwm.duty[i];
+  }
+  out[46] = chip->captureCtrl;
+  return STATE_SIZE;
+}
+
+/*
+  Blobs from another format version or variant are refused.
+*/
+bool stateValid(const chip_state_t * chip, const uint8_t * in, uint32_t len) {
+  if (len < STATE_SIZE || stateGet16(&in[0]) != STATE_MAGIC 
+        || in[2] != STATE_VERSION || in[3] != chip->config.variant) {
+    CHIP_LOG_WARN(chip, LOGEV_STATE_REJECTED, chip->instanceIdx, len);
+    return false;
+  }
+  return true;
+}
+
+/*
+  Load a blob into the chip's registers, without touching any pins.
+*/
+bool stateDecode(chip_state_t * chip, const uint8_t * in, uint32_t len, bool * intAsserted) {
+  if (! stateValid(chip, in, len)) {
+    return false;
+  }
+
+  *intAsserted = in[4] & STATE_FLAG_INT;
+  chip->expectCommand = in[4] & STATE_FLAG_EXPECT_COMMAND;
+  chip->pairWriteCount = (in[4] & STATE_FLAG_PAIR_HALF) ? 1 : 0;
+  chip->regPointer = in[5];
+  chip->outputReg = stateGet16(&in[6]);
+  chip->polarityReg = stateGet16(&in[8]);
+  chip->configReg = stateGet16(&in[10]);
+  chip->lastReadValue = stateGet16(&in[12]);
+  chip->keypad.ctrl = in[14];
+  chip->keypad.period = in[15];
+  chip->keypad.rowReg = stateGet16(&in[16]);
+  chip->keypad.colReg = stateGet16(&in[18]);
+  chip->intEnableReg = stateGet16(&in[20]);
+  chip->countRising = stateGet16(&in[22]);
+  chip->countFalling = stateGet16(&in[24]);
+  chip->pwm.pins = stateGet16(&in[26]);
+  chip->pwm.periodUs = stateGet16(&in[28]);
+  for (uint8_t i=0; i<NUM_GPIO; i++) {
+    chip->pwm.duty[i] = in[30 + i];
+  }
+  chip->captureCtrl = in[46];
+  chip->stagedPending = false;
+  chip->pwm.pending = false;
+  return true;
+}
+
+int8_t hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+/*
+  The "state" attribute, as printed by pca9535StateDump().
+*/
+bool stateFromAttr(chip_state_t * chip, bool * intAsserted) {
+  char hex[STATE_SIZE * 2 + 1];
+  uint8_t blob[STATE_SIZE];
+
+  HOST_COUNT(HOSTCALL_OTHER);
+  string_t attr = attr_string_init("state");
+  if (attr == STRING_NULL) {
+    return false;
+  }
+  string_read(attr, hex, sizeof(hex));
+  hex[sizeof(hex) - 1] = '\0';
+
+  for (uint8_t i=0; i<STATE_SIZE; i++) {
+    int8_t hi = hexValue(hex[i * 2]);
+    int8_t lo = (hi < 0) ? -1 : hexValue(hex[i * 2 + 1]);
+    if (lo < 0) {
+      CHIP_LOG_WARN(chip, LOGEV_STATE_REJECTED, chip->instanceIdx, i);
+      return false;
+    }
+    blob[i] = (hi << 4) | lo;
+  }
+  return stateDecode(chip, blob, STATE_SIZE, intAsserted);
+}
+
+/*
+  Where the host reads saved states from and writes them to.
+*/
+__attribute__((export_name("pca9535StateBuffer")))
+uint8_t * pca9535_state_buffer(void) {
+  return stateBuffer;
+}
+
+/*
+  Save chip instance idx into the state buffer, returns the 
+  blob length (0 if there's no such instance).
+*/
+__attribute__((export_name("pca9535StateSave")))
+uint32_t pca9535_state_save(uint32_t idx) {
+  const chip_state_t * chip = chipInstance(idx);
+  if (! chip) {
+    return 0;
+  }
+  return stateEncode(chip, stateBuffer);
+}
+
+/*
+  Apply len bytes from the state buffer to chip instance idx.
+  Goes through the same diff-based commit as i2c writes, so only
+  pins whose direction or level differ from the saved state get
+  a pin_mode (and watch change).  Returns 1 on success.
+*/
+__attribute__((export_name("pca9535StateRestore")))
+uint32_t pca9535_state_restore(uint32_t idx, uint32_t len) {
+  HOST_CONTEXT(HOSTCTX_INIT);
+  chip_state_t * chip = chipInstance(idx);
+  bool intAsserted;
+
+  if (! chip) {
+    return 0;
+  }
+
+  // checked before anything changes, a refused blob leaves the chip as it was
+  if (! stateValid(chip, stateBuffer, len)) {
+    return 0;
+  }
+
+  // the scan gives its pins back first, so the commit sees them all
+  keypadRelease(chip);
+  stateDecode(chip, stateBuffer, len, &intAsserted);
+  commitPinConfig(chip);
+  if (chip->keypad.ctrl & KP_CTRL_ENABLE) {
+    keypadClaim(chip);
+  }
+  // the waveform restarts from the saved registers
+  pwmApply(chip);
+
+  if (intAsserted != chip->intAsserted) {
+    if (intAsserted) {
+      interruptFlagOn(chip);
+    } else {
+      interruptFlagOff(chip);
+    }
+  }
+  return 1;
+}
+
+/*
+  Print every instance's state as hex, ready to paste into 
+  the "state" attribute.
+*/
+__attribute__((export_name("pca9535StateDump")))
+void pca9535_state_dump(void) {
+  uint8_t blob[STATE_SIZE];
+  for (uint8_t i=0; i<chipNumInstances(); i++) {
+    uint32_t len = stateEncode(chipInstance(i), blob);
+    chipPrintf("chip %u state ", i);
+    for (uint32_t b=0; b<len; b++) {
+      chipPrintf("%02x", blob[b]);
+    }
+    chipPrintf("\n");
+  }
+}
 
-  printf("I2C initialized @ address 0x%x\n", chip->address);
 
+
+/* Soft reset
+  Back to the power-on register state without restarting the 
+  simulation: all pins inputs, outputs latched HIGH, no polarity
+  inversion, key scan, edge counters and PWM off, nINT released.  The reset goes 
+  through the same diffing commit as an i2c write, so only pins 
+  that were outputs (or owned by the scan) are touched.
+  Triggered by a General Call reset, or by the host through 
+  pca9535Reset().
+*/
+#define GENERAL_CALL_ADDRESS  0x00
+#define GENERAL_CALL_RESET_BYTE  0x06
+
+void chipSoftReset(chip_state_t * chip) {
+  keypadRelease(chip);
+  chip->keypad.ctrl = 0;
+  chip->keypad.rowReg = 0;
+  chip->keypad.colReg = 0;
+  chip->keypad.period = 0;
+  // queued key events and the bitmap go too, or the KP count
+  // would hold nINT down after the reset
+  chip->keypad.fifoHead = 0;
+  chip->keypad.fifoTail = 0;
+  chip->keypad.overflow = false;
+  for (uint8_t r=0; r<KEYPAD_MAX_LINES; r++) {
+    chip->keypad.keys[r] = 0;
+    chip->keypad.keysSnapshot[r] = 0;
+  }
+
+  chip->outputReg = 0xffff;
+  chip->polarityReg = 0;
+  chip->configReg = 0xffff;
+  chip->intEnableReg = 0xffff;
+  chip->captureReg = 0;
+  chip->captureSnapshot = 0;
+  chip->captureCtrl = 0;
+  chip->countRising = 0;
+  chip->countFalling = 0;
+  for (uint8_t i=0; i<NUM_GPIO; i++) {
+    chip->counters[i] = 0;
+    chip->countersSnapshot[i] = 0;
+    chip->pwm.duty[i] = 0;
+  }
+  chip->pwm.pins = 0;
+  chip->pwm.periodUs = 0;
+  chip->pwm.pending = false;
+  commitPinConfig(chip);
+  pwmApply(chip);
+
+  chip->regPointer = REG_INPUT0;
+  chip->expectCommand = false;
+  chip->pairWriteCount = 0;
+
+  // whatever the inputs are now counts as read
+  if (chip->config.pollInputs) {
+    chip->inputValue = readInputsValue(chip);
+  }
+  chip->lastReadValue = chip->inputValue;
+  if (chip->evaluationPending) {
+    // a coalesced evaluation from before the reset has nothing left to decide
+    hostTimerStop(chip->coalesceTimer);
+    chip->evaluationPending = false;
+  }
   interruptFlagOff(chip);
 
+  CHIP_LOG_INFO(chip, LOGEV_SOFT_RESET, chip->instanceIdx, 0);
+}
+
+#if GENERAL_CALL_RESET
+/*
+  One extra i2c device at address 0 stands in for every instance, 
+  the General Call is a broadcast.  Only write transactions are 
+  acknowledged, and of those only the reset byte does anything.
+*/
+static i2c_config_t generalCallConfig;
+
+bool on_general_call_connect(void *user_data, uint32_t address, bool read) {
+  HOST_CONTEXT(HOSTCTX_I2C_CONNECT);
+  return ! read;
+}
+
+uint8_t on_general_call_read(void *user_data) {
+  return 0xff;
+}
+
+bool on_general_call_write(void *user_data, uint8_t data) {
+  HOST_CONTEXT(HOSTCTX_I2C_WRITE);
+  if (data != GENERAL_CALL_RESET_BYTE) {
+    return false;
+  }
+  for (uint8_t i=0; i<chipNumInstances(); i++) {
+    chipSoftReset(chipInstance(i));
+  }
+  return true;
+}
 
+void on_general_call_disconnect(void *user_data) {
 }
 
+void generalCallInit(chip_state_t * chip) {
+  generalCallConfig.scl = chip->i2c_config.scl;
+  generalCallConfig.sda = chip->i2c_config.sda;
+  generalCallConfig.address = GENERAL_CALL_ADDRESS;
+  generalCallConfig.connect = on_general_call_connect;
+  generalCallConfig.read = on_general_call_read;
+  generalCallConfig.write = on_general_call_write;
+  generalCallConfig.disconnect = on_general_call_disconnect;
+  generalCallConfig.user_data = NULL;
+  hostI2cInit(&generalCallConfig);
+}
+#else
+void generalCallInit(chip_state_t * chip) {
+}
+#endif
 
+/*
+  Reset one instance, or all of them with idx 0xff.
+  Returns how many were reset.
+*/
+__attribute__((export_name("pca9535Reset")))
+uint32_t pca9535_reset(uint32_t idx) {
+  HOST_CONTEXT(HOSTCTX_INIT);
+  if (idx == 0xff) {
+    for (uint8_t i=0; i<chipNumInstances(); i++) {
+      chipSoftReset(chipInstance(i));
+    }
+    return chipNumInstances();
+  }
 
+  chip_state_t * chip = chipInstance(idx);
+  if (! chip) {
+    return 0;
+  }
+  chipSoftReset(chip);
+  return 1;
+}
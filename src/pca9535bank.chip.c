@@ -0,0 +1,499 @@
+// Wokwi Custom Chip - For docs and examples see:
+// https://docs.wokwi.com/chips-api/getting-started
+//
+// PCA9535 bank: up to BANK_MAX_DEVICES expanders at consecutive
+// addresses behind one SCL/SDA pair, in a single chip instance.
+// Same register file as pca9535.chip.c (input, output, polarity,
+// configuration; pair-wise register pointer; reads served from a
+// snapshot; diffed pin commits), without the per-chip extras.
+//
+// SPDX-License-Identifier: GPL
+// Copyright 2023 Pat Deegan, https://psychogenic.com
+
+#include "wokwi-api.h"
+#include "pca9535-host.h"
+#include "pca9535-regs.h"
+
+// Devices per bank, pins for this many are declared in
+// pca9535bank.chip.json.  The "devices" attribute uses fewer.
+#define BANK_MAX_DEVICES  8
+#ifndef BANK_DEVICES
+#define BANK_DEVICES  BANK_MAX_DEVICES
+#endif
+
+// Wired-OR interrupt: all devices share the bank's nINT pin, which
+// is updated once per bank, instead of each driving its own Dn_nINT.
+#ifndef BANK_WIRED_INT
+#define BANK_WIRED_INT 0
+#endif
+
+// banks per module, state comes from a static pool
+#ifndef BANK_MAX_INSTANCES
+#define BANK_MAX_INSTANCES  2
+#endif
+#define BANK_STATE_ALIGN  64
+
+// pin_t -> (device, bit) lookup, 0xff for anything else.  Pin ids
+// past the table are found by searching the pin arrays instead.
+#define PIN_LOOKUP_SIZE  256
+#define PIN_NOT_IO  0xff
+#define PIN_ENTRY(dev, bit)  (((dev) << 4) | (bit))
+#define PIN_ENTRY_DEV(e)     ((e) >> 4)
+#define PIN_ENTRY_BIT(e)     ((e) & 0xf)
+
+#define BANKSTATE_FROM(usr_dat) bank_state_t * bank = (bank_state_t*)usr_dat
+
+
+/* Log messages
+  Event ids and formats for the logger in pca9535-host.h.
+*/
+typedef enum {
+  LOGEV_BANK_INIT = 0,
+  LOGEV_BANK_WIRED_INT,
+  LOGEV_POOL_EXHAUSTED,
+  LOGEV_NUM_EVENTS
+} log_event_t;
+
+// each format takes (at most) the two record arguments
+static const char * const logFormats[LOGEV_NUM_EVENTS] = {
+  [LOGEV_BANK_INIT] = "PCA9535 bank: %u devices from 0x%02x\n",
+  [LOGEV_BANK_WIRED_INT] = "PCA9535 bank: wired-OR nINT\n",
+  [LOGEV_POOL_EXHAUSTED] = "pca9535bank: more than %u banks\n",
+};
+
+
+/* Bank state
+  Structure of arrays: each register, mask and cache is one array
+  indexed by device, so a callback only touches the entries of the
+  device it is for, and the per-device cost is a few bytes rather
+  than a whole chip state.
+*/
+typedef struct __attribute__((aligned(BANK_STATE_ALIGN))) {
+  uint8_t numDevices;
+  uint8_t baseAddress;
+  bool wiredInt;
+
+  // register file
+  uint16_t outputReg[BANK_MAX_DEVICES];
+  uint16_t polarityReg[BANK_MAX_DEVICES];
+  uint16_t configReg[BANK_MAX_DEVICES];
+  uint8_t regPointer[BANK_MAX_DEVICES];
+
+  // what the pins are actually set to
+  uint16_t inputMask[BANK_MAX_DEVICES];
+  uint16_t appliedOutput[BANK_MAX_DEVICES];
+
+  // input levels, kept up to date from the watch callbacks,
+  // and what the firmware last read
+  uint16_t inputValue[BANK_MAX_DEVICES];
+  uint16_t lastReadValue[BANK_MAX_DEVICES];
+
+  // nINT, one bit per device
+  uint8_t intAsserted;
+  bool sharedIntAsserted;
+
+  // current transaction: only one device talks at a time
+  uint8_t device;
+  bool expectCommand;
+  uint8_t pairWriteCount;
+  bool stagedPending;
+  uint8_t readSnapshot[NUM_REGS];
+
+  // set while a commit changes a device's pin modes, that device's
+  // edges arriving meanwhile are only noted and resynced afterwards
+  bool reconfiguring;
+  uint8_t reconfigDevice;
+  uint16_t reconfigEdges;
+  // raw input levels behind the input bytes of the snapshot
+  uint16_t snapshotInputs;
+
+  pin_t io[BANK_MAX_DEVICES][NUM_GPIO];
+  pin_t nINT[BANK_MAX_DEVICES];
+  pin_t sharedInt;
+  uint8_t pinLookup[PIN_LOOKUP_SIZE];
+
+  i2c_config_t i2c_config[BANK_MAX_DEVICES];
+  pin_watch_config_t io_watch_config;
+} bank_state_t;
+
+static bank_state_t bankPool[BANK_MAX_INSTANCES];
+static uint8_t bankCount;
+
+
+/*
+  Read an attribute, or its default when the diagram doesn't set it.
+*/
+uint32_t bankAttr(const char * name, uint32_t defaultValue) {
+  return attr_read(attr_init(name, defaultValue));
+}
+
+uint8_t pinEntry(const bank_state_t * bank, pin_t pin) {
+  if (pin >= 0 && pin < PIN_LOOKUP_SIZE) {
+    return bank->pinLookup[pin];
+  }
+  for (uint8_t dev=0; dev<bank->numDevices; dev++) {
+    for (uint8_t i=0; i<NUM_GPIO; i++) {
+      if (bank->io[dev][i] == pin) {
+        return PIN_ENTRY(dev, i);
+      }
+    }
+  }
+  return PIN_NOT_IO;
+}
+
+
+/* Interrupt
+  Per device, nINT is asserted while any input differs from what
+  the firmware last read.  With the wired-OR nINT only the bank
+  level changes reach the pin.
+*/
+void bankUpdateSharedInt(bank_state_t * bank) {
+  bool asserted = bank->intAsserted != 0;
+  if (asserted == bank->sharedIntAsserted) {
+    return;
+  }
+  hostPinMode(bank->sharedInt, asserted ? OUTPUT_LOW : INPUT);
+  bank->sharedIntAsserted = asserted;
+}
+
+void deviceSetInt(bank_state_t * bank, uint8_t dev, bool asserted) {
+  uint8_t bit = (1 << dev);
+  if (asserted == ((bank->intAsserted & bit) != 0)) {
+    return;
+  }
+
+  if (asserted) {
+    bank->intAsserted |= bit;
+  } else {
+    bank->intAsserted &= ~bit;
+  }
+
+  if (bank->wiredInt) {
+    bankUpdateSharedInt(bank);
+  } else {
+    hostPinMode(bank->nINT[dev], asserted ? OUTPUT_LOW : INPUT);
+  }
+}
+
+void deviceEvaluateInputs(bank_state_t * bank, uint8_t dev) {
+  deviceSetInt(bank, dev, bank->inputValue[dev] != bank->lastReadValue[dev]);
+}
+
+
+/* Pins
+*/
+uint16_t deviceReadInputs(bank_state_t * bank, uint8_t dev) {
+  uint16_t value = 0;
+  for (uint8_t i=0; i<NUM_GPIO; i++) {
+    if ((bank->inputMask[dev] & (1 << i)) && hostPinRead(bank->io[dev][i])) {
+      value |= (1 << i);
+    }
+  }
+  return value;
+}
+
+uint32_t pinModeFor(bool isInput, bool level) {
+  if (isInput) {
+    return INPUT;
+  }
+  return level ? INPUT_PULLUP : OUTPUT_LOW;
+}
+
+/*
+  Apply a device's staged output/config registers, touching only
+  the pins whose direction or level changed.
+*/
+void deviceCommit(bank_state_t * bank, uint8_t dev) {
+  uint16_t config = bank->configReg[dev];
+  uint16_t dirChanged = bank->inputMask[dev] ^ config;
+  uint16_t levelChanged = (bank->appliedOutput[dev] ^ bank->outputReg[dev]) & ~config;
+  uint16_t changed = dirChanged | levelChanged;
+  uint16_t newInputs = dirChanged & config;
+
+  bank->stagedPending = false;
+  if (! changed) {
+    return;
+  }
+
+  // our own mode changes can call straight back into
+  // chip_bank_io_change, hold those until the batch is done
+  bank->reconfiguring = true;
+  bank->reconfigDevice = dev;
+  bank->reconfigEdges = 0;
+
+  for (uint8_t i=0; i<NUM_GPIO; i++) {
+    uint16_t bit = (1 << i);
+    if (! (changed & bit)) {
+      continue;
+    }
+
+    pin_t targetPin = bank->io[dev][i];
+    uint32_t oldMode = pinModeFor(bank->inputMask[dev] & bit, bank->appliedOutput[dev] & bit);
+    uint32_t newMode = pinModeFor(config & bit, bank->outputReg[dev] & bit);
+
+    if ((dirChanged & bit) && ! (config & bit)) {
+      hostPinWatchStop(targetPin);
+    }
+    if (oldMode != newMode) {
+      hostPinMode(targetPin, newMode);
+    }
+    if (newInputs & bit) {
+      hostPinWatch(targetPin, &(bank->io_watch_config));
+    }
+  }
+
+  bank->inputMask[dev] = config;
+  bank->appliedOutput[dev] = bank->outputReg[dev];
+
+  // outputs drop out, pins that just became inputs or saw an
+  // edge during the batch are read
+  uint16_t edges = bank->reconfigEdges & config;
+  uint16_t resync = newInputs | edges;
+  bank->inputValue[dev] &= config & ~resync;
+  for (uint8_t i=0; i<NUM_GPIO; i++) {
+    if ((resync & (1 << i)) && hostPinRead(bank->io[dev][i])) {
+      bank->inputValue[dev] |= (1 << i);
+    }
+  }
+  bank->reconfiguring = false;
+
+  // a direction change isn't an input change: pins that just became
+  // inputs start out as read, outputs drop out of the comparison
+  bank->lastReadValue[dev] = (bank->lastReadValue[dev] & ~dirChanged) | (bank->inputValue[dev] & dirChanged);
+
+  // one nINT decision for whatever the batch added up to
+  if (edges | dirChanged) {
+    deviceEvaluateInputs(bank, dev);
+  }
+}
+
+void chip_bank_io_change(void *user_data, pin_t pin, uint32_t value) {
+  HOST_CONTEXT(HOSTCTX_INPUT_CHANGE);
+  BANKSTATE_FROM(user_data);
+  uint8_t entry = pinEntry(bank, pin);
+  if (entry == PIN_NOT_IO) {
+    return;
+  }
+
+  uint8_t dev = PIN_ENTRY_DEV(entry);
+  uint16_t bit = (1 << PIN_ENTRY_BIT(entry));
+  if (bank->reconfiguring && dev == bank->reconfigDevice) {
+    // mid-commit, deviceCommit resyncs these when it's done
+    bank->reconfigEdges |= bit;
+    return;
+  }
+  if (! (bank->inputMask[dev] & bit)) {
+    return;
+  }
+  if (value) {
+    bank->inputValue[dev] |= bit;
+  } else {
+    bank->inputValue[dev] &= ~bit;
+  }
+  deviceEvaluateInputs(bank, dev);
+}
+
+
+/* I2C
+  Every device address is registered with the same callbacks and
+  user data, the address handed to connect selects the device for
+  the rest of the transaction.
+*/
+bool on_bank_i2c_connect(void *user_data, uint32_t address, bool read) {
+  HOST_CONTEXT(HOSTCTX_I2C_CONNECT);
+  BANKSTATE_FROM(user_data);
+  uint8_t dev = address - bank->baseAddress;
+  if (address < bank->baseAddress || dev >= bank->numDevices) {
+    return false;
+  }
+
+  // a repeated start, possibly to another device, ends the write before it
+  if (bank->stagedPending) {
+    deviceCommit(bank, bank->device);
+  }
+
+  bank->device = dev;
+  bank->pairWriteCount = 0;
+  if (! read) {
+    bank->expectCommand = true;
+    return true;
+  }
+
+  bank->snapshotInputs = bank->inputValue[dev];
+  uint16_t polarized = inputPortValue(bank->snapshotInputs, bank->appliedOutput[dev], 
+                                      bank->inputMask[dev], bank->polarityReg[dev]);
+  bank->readSnapshot[REG_INPUT0] = polarized & 0xff;
+  bank->readSnapshot[REG_INPUT1] = polarized >> 8;
+  bank->readSnapshot[REG_OUTPUT0] = bank->outputReg[dev] & 0xff;
+  bank->readSnapshot[REG_OUTPUT1] = bank->outputReg[dev] >> 8;
+  bank->readSnapshot[REG_POLARITY0] = bank->polarityReg[dev] & 0xff;
+  bank->readSnapshot[REG_POLARITY1] = bank->polarityReg[dev] >> 8;
+  bank->readSnapshot[REG_CONFIG0] = bank->configReg[dev] & 0xff;
+  bank->readSnapshot[REG_CONFIG1] = bank->configReg[dev] >> 8;
+  return true;
+}
+
+uint8_t on_bank_i2c_read(void *user_data) {
+  HOST_CONTEXT(HOSTCTX_I2C_READ);
+  BANKSTATE_FROM(user_data);
+  uint8_t dev = bank->device;
+  uint8_t reg = bank->regPointer[dev];
+  uint8_t retVal = bank->readSnapshot[reg];
+
+  if ((reg & ~1) == REG_INPUT0) {
+    // reading an input port resets the interrupt, for exactly what
+    // was returned: the snapshot, and only this port of it
+    uint16_t portMask = 0xff << ((reg & 1) * 8);
+    bank->lastReadValue[dev] = (bank->lastReadValue[dev] & ~portMask) | (bank->snapshotInputs & portMask);
+    deviceEvaluateInputs(bank, dev);
+  }
+
+  // toggles within the register pair, as on the real part
+  bank->regPointer[dev] = reg ^ 1;
+  return retVal;
+}
+
+bool on_bank_i2c_write(void *user_data, uint8_t data) {
+  HOST_CONTEXT(HOSTCTX_I2C_WRITE);
+  BANKSTATE_FROM(user_data);
+  uint8_t dev = bank->device;
+
+  if (bank->expectCommand) {
+    bank->expectCommand = false;
+    bank->regPointer[dev] = data & (NUM_REGS - 1);
+    return true;
+  }
+
+  uint8_t reg = bank->regPointer[dev];
+  uint8_t shift = (reg & 1) * 8;
+  uint16_t keep = ~(0xff << shift);
+
+  switch (reg & ~1) {
+    case REG_INPUT0:
+      break;
+    case REG_OUTPUT0:
+      bank->outputReg[dev] = (bank->outputReg[dev] & keep) | (data << shift);
+      bank->stagedPending = true;
+      break;
+    case REG_POLARITY0:
+      bank->polarityReg[dev] = (bank->polarityReg[dev] & keep) | (data << shift);
+      break;
+    default:
+      bank->configReg[dev] = (bank->configReg[dev] & keep) | (data << shift);
+      bank->stagedPending = true;
+      break;
+  }
+  bank->regPointer[dev] = reg ^ 1;
+
+  if (++bank->pairWriteCount >= 2) {
+    bank->pairWriteCount = 0;
+    if (bank->stagedPending) {
+      deviceCommit(bank, dev);
+    }
+  }
+  return true;
+}
+
+void on_bank_i2c_disconnect(void *user_data) {
+  HOST_CONTEXT(HOSTCTX_I2C_DISCONNECT);
+  BANKSTATE_FROM(user_data);
+  if (bank->stagedPending) {
+    deviceCommit(bank, bank->device);
+  }
+}
+
+
+/*
+  Pin names are "D<device>_<pin>", e.g. D3_P17 or D3_nINT.
+*/
+const char * devicePinName(char * name, uint8_t dev, const char * pin) {
+  uint32_t len = 0;
+  name[len++] = 'D';
+  len += formatNumber(&name[len], dev, 10, 0, ' ');
+  name[len++] = '_';
+  while (*pin) {
+    name[len++] = *pin++;
+  }
+  name[len] = '\0';
+  return name;
+}
+
+/*
+  Chip initialization, called on startup.  Everything is powered
+  up as inputs, so each device costs its 16 pin_init and 16
+  pin_watch calls and one i2c_init, nothing more.
+*/
+void chip_init() {
+  if (! bankCount) {
+    logInit(logFormats);
+  }
+  if (bankCount >= BANK_MAX_INSTANCES) {
+    LOG_ERROR(LOGEV_POOL_EXHAUSTED, BANK_MAX_INSTANCES, 0);
+    return;
+  }
+  bank_state_t * bank = &(bankPool[bankCount++]);
+
+  bank->numDevices = bankAttr("devices", BANK_DEVICES);
+  if (bank->numDevices < 1 || bank->numDevices > BANK_MAX_DEVICES) {
+    bank->numDevices = BANK_MAX_DEVICES;
+  }
+  bank->baseAddress = bankAttr("address", I2C_BASE_ADDRESS);
+  bank->wiredInt = bankAttr("wiredInt", BANK_WIRED_INT) != 0;
+
+  for (uint16_t i=0; i<PIN_LOOKUP_SIZE; i++) {
+    bank->pinLookup[i] = PIN_NOT_IO;
+  }
+
+  bank->io_watch_config.edge = BOTH;
+  bank->io_watch_config.pin_change = chip_bank_io_change;
+  bank->io_watch_config.user_data = bank;
+
+  if (bank->wiredInt) {
+    bank->sharedInt = hostPinInit("nINT", INPUT);
+  }
+  pin_t scl = hostPinInit("SCL", INPUT_PULLUP);
+  pin_t sda = hostPinInit("SDA", INPUT_PULLUP);
+
+  char name[12];
+  for (uint8_t dev=0; dev<bank->numDevices; dev++) {
+    // power-on register defaults
+    bank->outputReg[dev] = 0xffff;
+    bank->polarityReg[dev] = 0;
+    bank->configReg[dev] = 0xffff;
+    bank->regPointer[dev] = REG_INPUT0;
+    bank->inputMask[dev] = 0xffff;
+    bank->appliedOutput[dev] = 0xffff;
+
+    if (! bank->wiredInt) {
+      bank->nINT[dev] = hostPinInit(devicePinName(name, dev, "nINT"), INPUT);
+    }
+
+    for (uint8_t i=0; i<NUM_GPIO; i++) {
+      const char ioName[] = {'P', '0' + i / 8, '0' + i % 8, '\0'};
+      pin_t pin = hostPinInit(devicePinName(name, dev, ioName), INPUT);
+      bank->io[dev][i] = pin;
+      if (pin >= 0 && pin < PIN_LOOKUP_SIZE) {
+        bank->pinLookup[pin] = PIN_ENTRY(dev, i);
+      }
+      hostPinWatch(pin, &(bank->io_watch_config));
+    }
+    bank->inputValue[dev] = deviceReadInputs(bank, dev);
+    bank->lastReadValue[dev] = bank->inputValue[dev];
+
+    i2c_config_t * i2c = &(bank->i2c_config[dev]);
+    i2c->address = bank->baseAddress + dev;
+    i2c->scl = scl;
+    i2c->sda = sda;
+    i2c->connect = on_bank_i2c_connect;
+    i2c->read = on_bank_i2c_read;
+    i2c->write = on_bank_i2c_write;
+    i2c->disconnect = on_bank_i2c_disconnect;
+    i2c->user_data = bank;
+    hostI2cInit(i2c);
+  }
+
+  LOG_INFO(LOGEV_BANK_INIT, bank->numDevices, bank->baseAddress);
+  if (bank->wiredInt) {
+    LOG_INFO(LOGEV_BANK_WIRED_INT, 0, 0);
+  }
+}
@@ -0,0 +1,237 @@
+// Bus stress firmware for the pca9535 chip, see stress/README.md.
+// Builds for ESP32 and AVR (Uno) with arduino-cli; one scenario per
+// build, selected with -DSTRESS_SCENARIO and -DSTRESS_I2C_HZ.
+//
+// Results are printed as a single "STRESS RESULT" line, followed by
+// "STRESS DONE" so wokwi-cli can stop the simulation.
+//
+// SPDX-License-Identifier: MIT
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#define STRESS_READ       1   // back-to-back 2-byte input reads
+#define STRESS_BURST      2   // 16-byte output burst writes
+#define STRESS_INT_STORM  3   // nINT driven reads while P00 toggles
+#define STRESS_BUS        4   // round robin reads over 8 chips
+
+#ifndef STRESS_SCENARIO
+#define STRESS_SCENARIO  STRESS_READ
+#endif
+
+#ifndef STRESS_I2C_HZ
+#define STRESS_I2C_HZ  400000
+#endif
+
+// simulated run time
+#ifndef STRESS_SECONDS
+#define STRESS_SECONDS  5
+#endif
+
+// edge storm: square wave on P00, so twice as many edges
+#ifndef STRESS_STORM_HZ
+#define STRESS_STORM_HZ  2000
+#endif
+
+#if defined(ARDUINO_ARCH_ESP32)
+#define BOARD_NAME       "esp32"
+#define PIN_INT          4
+#define PIN_STORM_OUT    5
+#define PIN_STORM_SENSE  18
+#else
+#define BOARD_NAME       "avr"
+#define PIN_INT          2
+#define PIN_STORM_OUT    9
+#define PIN_STORM_SENSE  3
+#endif
+
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
+
+#define CHIP_ADDRESS  0x20
+#if STRESS_SCENARIO == STRESS_BUS
+#define NUM_CHIPS  8
+#else
+#define NUM_CHIPS  1
+#endif
+
+#define REG_INPUT0   0
+#define REG_OUTPUT0  2
+#define REG_CONFIG0  6
+
+#define BURST_BYTES  16
+
+static const char * const scenarioNames[] = {"", "read", "burst-write", "int-storm", "bus-8chips"};
+
+static volatile uint32_t intCount;    // nINT falling edges
+static volatile uint32_t stormEdges;  // edges driven onto P00
+static volatile bool intPending;
+
+static uint32_t transactions;
+static uint32_t nacks;
+static uint32_t observedChanges;      // P00 changes seen through reads
+static uint8_t lastP00;
+
+
+static void IRAM_ATTR onInt() {
+  intCount++;
+  intPending = true;
+}
+
+static void IRAM_ATTR onStormEdge() {
+  stormEdges++;
+}
+
+static uint32_t atomicRead(volatile uint32_t *counter) {
+  noInterrupts();
+  uint32_t value = *counter;
+  interrupts();
+  return value;
+}
+
+static bool readInputs(uint8_t address, uint16_t *value) {
+  Wire.beginTransmission(address);
+  Wire.write(REG_INPUT0);
+  if (Wire.endTransmission(false) != 0) {
+    nacks++;
+    return false;
+  }
+  if (Wire.requestFrom((int)address, 2) != 2) {
+    nacks++;
+    return false;
+  }
+  *value = Wire.read();
+  *value |= (uint16_t)Wire.read() << 8;
+  transactions++;
+  return true;
+}
+
+static bool writeRegisters(uint8_t address, uint8_t reg, const uint8_t *data, uint8_t len) {
+  Wire.beginTransmission(address);
+  Wire.write(reg);
+  Wire.write(data, len);
+  if (Wire.endTransmission() != 0) {
+    nacks++;
+    return false;
+  }
+  transactions++;
+  return true;
+}
+
+static void readP00() {
+  uint16_t value;
+  if (readInputs(CHIP_ADDRESS, &value)) {
+    uint8_t p00 = value & 1;
+    if (p00 != lastP00) {
+      observedChanges++;
+      lastP00 = p00;
+    }
+  }
+}
+
+
+static void setupScenario() {
+  if (STRESS_SCENARIO == STRESS_BURST) {
+    const uint8_t outputs[] = {0x00, 0x00};
+    writeRegisters(CHIP_ADDRESS, REG_CONFIG0, outputs, sizeof(outputs));
+  }
+
+  if (STRESS_SCENARIO == STRESS_INT_STORM) {
+    pinMode(PIN_STORM_OUT, OUTPUT);
+    digitalWrite(PIN_STORM_OUT, LOW);
+    pinMode(PIN_INT, INPUT_PULLUP);
+    pinMode(PIN_STORM_SENSE, INPUT);
+
+    // baseline read clears nINT before counting starts
+    uint16_t value;
+    readInputs(CHIP_ADDRESS, &value);
+    lastP00 = value & 1;
+
+    attachInterrupt(digitalPinToInterrupt(PIN_INT), onInt, FALLING);
+    attachInterrupt(digitalPinToInterrupt(PIN_STORM_SENSE), onStormEdge, CHANGE);
+    tone(PIN_STORM_OUT, STRESS_STORM_HZ);
+  }
+}
+
+static void stepScenario(uint32_t iteration) {
+  uint16_t value;
+  uint8_t burst[BURST_BYTES];
+
+  switch (STRESS_SCENARIO) {
+    case STRESS_READ:
+      readInputs(CHIP_ADDRESS, &value);
+      break;
+    case STRESS_BURST:
+      for (uint8_t i=0; i<BURST_BYTES; i++) {
+        burst[i] = (iteration & 1) ? 0x55 : 0xaa;
+      }
+      writeRegisters(CHIP_ADDRESS, REG_OUTPUT0, burst, sizeof(burst));
+      break;
+    case STRESS_INT_STORM:
+      if (intPending) {
+        intPending = false;
+        readP00();
+      }
+      break;
+    case STRESS_BUS:
+      readInputs(CHIP_ADDRESS + (iteration % NUM_CHIPS), &value);
+      break;
+  }
+}
+
+static void finishScenario() {
+  if (STRESS_SCENARIO == STRESS_INT_STORM) {
+    noTone(PIN_STORM_OUT);
+    delay(2);
+    detachInterrupt(digitalPinToInterrupt(PIN_STORM_SENSE));
+    // anything still latched on nINT is picked up, not missed
+    if (intPending) {
+      intPending = false;
+      readP00();
+    }
+  }
+}
+
+static void report(const char *tag, uint32_t elapsedMs) {
+  char line[160];
+  uint32_t edges = atomicRead(&stormEdges);
+  uint32_t missed = (edges > observedChanges) ? edges - observedChanges : 0;
+  uint32_t tps = elapsedMs ? (uint32_t)((uint64_t)transactions * 1000 / elapsedMs) : 0;
+
+  snprintf(line, sizeof(line),
+           "STRESS %s board=%s scenario=%s i2c_hz=%lu chips=%u sim_ms=%lu tx=%lu tps=%lu nacks=%lu ints=%lu edges=%lu missed=%lu",
+           tag, BOARD_NAME, scenarioNames[STRESS_SCENARIO], (unsigned long)STRESS_I2C_HZ, NUM_CHIPS,
+           (unsigned long)elapsedMs, (unsigned long)transactions, (unsigned long)tps,
+           (unsigned long)nacks, (unsigned long)atomicRead(&intCount), (unsigned long)edges,
+           (unsigned long)missed);
+  Serial.println(line);
+}
+
+
+void setup() {
+  Serial.begin(115200);
+  Wire.begin();
+  Wire.setClock(STRESS_I2C_HZ);
+
+  setupScenario();
+
+  uint32_t start = millis();
+  uint32_t nextProgress = 1000;
+  uint32_t elapsed = 0;
+  for (uint32_t i=0; elapsed < STRESS_SECONDS * 1000UL; i++) {
+    stepScenario(i);
+    elapsed = millis() - start;
+    if (elapsed >= nextProgress) {
+      report("PROGRESS", elapsed);
+      nextProgress += 1000;
+    }
+  }
+
+  finishScenario();
+  report("RESULT", elapsed);
+  Serial.println("STRESS DONE");
+}
+
+void loop() {
+}
@@ -0,0 +1,49 @@
+#!/bin/sh
+# Run the bus stress scenarios in wokwi-cli and tabulate the results.
+#
+#   ./run.sh                       every board/scenario
+#   ./run.sh esp32/int-storm ...   just these
+#
+# Needs wokwi-cli with WOKWI_CLI_TOKEN set, the firmware from `make`
+# and the chip in ../dist (make wasm).  A copy of the table is kept in
+# results/<label>.txt (label: $STRESS_LABEL, default git describe) so
+# runs against different chip releases can be compared.
+#
+# SPDX-License-Identifier: MIT
+
+set -e
+cd "$(dirname "$0")"
+
+STRESS_SECONDS=${STRESS_SECONDS:-5}
+LABEL=${STRESS_LABEL:-$(git describe --always --dirty 2>/dev/null || echo local)}
+SCENARIOS=${*:-$(ls -d esp32/*/ avr/*/ | sed 's:/$::')}
+
+if [ ! -f ../dist/chip.wasm ]; then
+  echo "../dist/chip.wasm missing, build it with 'make wasm' in .. (or 'make run' here)" >&2
+  exit 1
+fi
+# wokwi looks for the chip definition next to the binary
+[ -f ../dist/chip.json ] || cp ../pca9535.chip.json ../dist/chip.json
+
+mkdir -p results
+OUT=results/$LABEL.txt
+
+# sim_ms / wall_ms is the simulation speed, 1.00 being real time
+printf "%-24s %8s %8s %8s %6s %8s %8s %7s\n" scenario sim_ms tx/s nacks ints edges missed speed | tee "$OUT"
+
+for s in $SCENARIOS; do
+  log=build/$s/serial.log
+  start=$(date +%s%N)
+  if ! wokwi-cli --quiet --timeout $(( (STRESS_SECONDS + 30) * 1000 )) \
+         --expect-text "STRESS DONE" --serial-log-file "$log" "$s" >/dev/null; then
+    printf "%-24s failed, see %s\n" "$s" "$log" | tee -a "$OUT"
+    continue
+  fi
+  wall_ms=$(( ($(date +%s%N) - start) / 1000000 ))
+
+  grep "STRESS RESULT" "$log" | tail -1 | awk -v s="$s" -v wall="$wall_ms" '{
+    for (i=3; i<=NF; i++) { split($i, kv, "="); f[kv[1]] = kv[2] }
+    printf "%-24s %8d %8d %8d %6d %8d %8d %7.2f\n", s, f["sim_ms"], f["tps"], f["nacks"],
+           f["ints"], f["edges"], f["missed"], wall ? f["sim_ms"] / wall : 0
+  }' | tee -a "$OUT"
+done
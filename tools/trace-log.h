@@ -0,0 +1,86 @@
+// Reading the chip's event trace back out of a console log, shared
+// by the native tools (trace2vcd, bench/replay.c).
+//
+// SPDX-License-Identifier: MIT
+
+#ifndef TRACE_LOG_H
+#define TRACE_LOG_H
+
+#include "pca9535-trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_LOG_MAX_LINE  4096
+
+typedef struct {
+  trace_record_t *records;
+  size_t count;
+  size_t capacity;
+} trace_log_t;
+
+static int traceLogHexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+static void traceLogAdd(trace_log_t *log, const uint8_t *b) {
+  if (log->count == log->capacity) {
+    log->capacity = log->capacity ? log->capacity * 2 : 4096;
+    log->records = realloc(log->records, log->capacity * sizeof(trace_record_t));
+    if (! log->records) {
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+    }
+  }
+  trace_record_t *rec = &log->records[log->count++];
+  rec->delta = (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+  rec->type = b[4];
+  rec->source = b[5];
+  rec->value = (uint16_t)(b[6] | (b[7] << 8));
+}
+
+static void traceLogParseLine(trace_log_t *log, const char *line) {
+  const char *p = strstr(line, TRACE_LINE_PREFIX);
+  if (! p) {
+    return;
+  }
+  p += strlen(TRACE_LINE_PREFIX);
+
+  uint8_t rec[TRACE_RECORD_SIZE];
+  int n = 0;
+  for (;;) {
+    int hi = traceLogHexValue(p[0]);
+    int lo = (hi < 0) ? -1 : traceLogHexValue(p[1]);
+    if (lo < 0) {
+      break;
+    }
+    rec[n++] = (uint8_t)((hi << 4) | lo);
+    p += 2;
+    if (n == TRACE_RECORD_SIZE) {
+      traceLogAdd(log, rec);
+      n = 0;
+    }
+  }
+}
+
+/*
+  Every trace record in a console log, in order.  Lines that
+  aren't trace lines are skipped.
+*/
+static void traceLogRead(trace_log_t *log, FILE *in) {
+  static char line[TRACE_LOG_MAX_LINE];
+  while (fgets(line, sizeof(line), in)) {
+    traceLogParseLine(log, line);
+  }
+}
+
+static void traceLogFree(trace_log_t *log) {
+  free(log->records);
+  log->records = NULL;
+  log->count = log->capacity = 0;
+}
+
+#endif /* TRACE_LOG_H */
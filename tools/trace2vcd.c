@@ -0,0 +1,247 @@
+// Convert the chip's binary event trace (see src/pca9535-trace.h)
+// into a VCD file for waveform viewers such as GTKWave.
+//
+//   dist/trace2vcd < simulation.log > trace.vcd
+//
+// Input is the simulation console output: any line containing
+// TRACE_LINE_PREFIX is decoded, everything else is ignored.
+//
+// SPDX-License-Identifier: MIT
+
+#include "trace-log.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_CHIPS     8
+#define NUM_GPIO      16
+
+// per chip: 16 pins, nINT, config, i2c read, i2c write, i2c busy
+#define VAR_NINT      NUM_GPIO
+#define VAR_CONFIG    (NUM_GPIO + 1)
+#define VAR_I2C_READ  (NUM_GPIO + 2)
+#define VAR_I2C_WRITE (NUM_GPIO + 3)
+#define VAR_I2C_BUSY  (NUM_GPIO + 4)
+#define VARS_PER_CHIP (NUM_GPIO + 5)
+
+typedef struct {
+  bool seen;
+  uint16_t config;    // 1 = input
+  uint16_t output;
+  uint16_t inputs;    // last level seen on each input pin
+  uint16_t seenInputs; // pins that had an input edge
+  uint16_t pins;      // resolved pin levels, as dumped
+  uint16_t unknown;   // pins dumped as x
+  bool intAsserted;
+} chip_trace_state_t;
+
+static trace_log_t traceLog;
+
+static chip_trace_state_t chips[MAX_CHIPS];
+static uint64_t now;
+static uint64_t lastDumpedTime = UINT64_MAX;
+
+
+/*
+  VCD identifiers are short printable strings, we just use
+  base-94 numbers over '!'..'~'.
+*/
+static const char * varId(int chip, int var) {
+  static char id[4];
+  int n = chip * VARS_PER_CHIP + var;
+  int len = 0;
+  do {
+    id[len++] = (char)('!' + n % 94);
+    n /= 94;
+  } while (n && len < 3);
+  id[len] = '\0';
+  return id;
+}
+
+static void dumpTime(void) {
+  if (now != lastDumpedTime) {
+    printf("#%llu\n", (unsigned long long)now);
+    lastDumpedTime = now;
+  }
+}
+
+static void dumpBit(int chip, int var, bool value) {
+  printf("%c%s\n", value ? '1' : '0', varId(chip, var));
+}
+
+static void dumpUnknown(int chip, int var) {
+  printf("x%s\n", varId(chip, var));
+}
+
+static void dumpVector(int chip, int var, uint16_t value, int width) {
+  char bits[17];
+  for (int i=0; i<width; i++) {
+    bits[i] = (value & (1 << (width - 1 - i))) ? '1' : '0';
+  }
+  bits[width] = '\0';
+  printf("b%s %s\n", bits, varId(chip, var));
+}
+
+/*
+  Pin levels: inputs follow their last edge, outputs follow
+  the output latch.  The trace has no record of an input's
+  level before its first edge, so until then it is x.  Only
+  changed pins get dumped.
+*/
+static void resolvePins(int c) {
+  chip_trace_state_t *chip = &chips[c];
+  uint16_t levels = (chip->inputs & chip->config) | (chip->output & ~chip->config);
+  uint16_t unknown = chip->config & ~chip->seenInputs;
+  uint16_t changed = ((levels ^ chip->pins) & ~unknown) | (unknown ^ chip->unknown);
+  if (! changed) {
+    return;
+  }
+  dumpTime();
+  for (int i=0; i<NUM_GPIO; i++) {
+    if (! (changed & (1 << i))) {
+      continue;
+    }
+    if (unknown & (1 << i)) {
+      dumpUnknown(c, i);
+    } else {
+      dumpBit(c, i, levels & (1 << i));
+    }
+  }
+  chip->pins = levels;
+  chip->unknown = unknown;
+}
+
+static void resetChip(chip_trace_state_t *chip) {
+  chip->config = 0xffff;
+  chip->output = 0xffff;
+  chip->inputs = 0;
+  chip->seenInputs = 0;
+  chip->pins = 0;
+  chip->unknown = 0xffff;
+  chip->intAsserted = false;
+}
+
+static void writeHeader(void) {
+  printf("$timescale 1ns $end\n");
+  for (int c=0; c<MAX_CHIPS; c++) {
+    if (! chips[c].seen) {
+      continue;
+    }
+    printf("$scope module pca9535_%d $end\n", c);
+    for (int i=0; i<NUM_GPIO; i++) {
+      printf("$var wire 1 %s P%d%d $end\n", varId(c, i), i / 8, i % 8);
+    }
+    printf("$var wire 1 %s nINT $end\n", varId(c, VAR_NINT));
+    printf("$var wire 16 %s config $end\n", varId(c, VAR_CONFIG));
+    printf("$var wire 8 %s i2c_read $end\n", varId(c, VAR_I2C_READ));
+    printf("$var wire 8 %s i2c_write $end\n", varId(c, VAR_I2C_WRITE));
+    printf("$var wire 1 %s i2c_busy $end\n", varId(c, VAR_I2C_BUSY));
+    printf("$upscope $end\n");
+  }
+  printf("$enddefinitions $end\n");
+
+  printf("#0\n$dumpvars\n");
+  for (int c=0; c<MAX_CHIPS; c++) {
+    if (! chips[c].seen) {
+      continue;
+    }
+    resetChip(&chips[c]);
+    // power-up: all inputs, levels unknown until their first edge
+    for (int i=0; i<NUM_GPIO; i++) {
+      dumpUnknown(c, i);
+    }
+    dumpBit(c, VAR_NINT, true);
+    dumpVector(c, VAR_CONFIG, 0xffff, 16);
+    printf("bx %s\n", varId(c, VAR_I2C_READ));
+    printf("bx %s\n", varId(c, VAR_I2C_WRITE));
+    dumpBit(c, VAR_I2C_BUSY, false);
+  }
+  printf("$end\n");
+  lastDumpedTime = 0;
+}
+
+int main(void) {
+  traceLogRead(&traceLog, stdin);
+  const trace_record_t *records = traceLog.records;
+  size_t numRecords = traceLog.count;
+
+  if (! numRecords) {
+    fprintf(stderr, "no trace records found\n");
+    return 1;
+  }
+
+  for (size_t i=0; i<numRecords; i++) {
+    int c = traceChip(&records[i]);
+    if (c < MAX_CHIPS && records[i].type != TRACE_EV_HEADER && records[i].type != TRACE_EV_WAIT) {
+      chips[c].seen = true;
+    }
+  }
+
+  writeHeader();
+
+  for (size_t i=0; i<numRecords; i++) {
+    const trace_record_t *rec = &records[i];
+    int c = traceChip(rec);
+    chip_trace_state_t *chip = &chips[c];
+    now += rec->delta;
+
+    switch (rec->type) {
+      case TRACE_EV_HEADER:
+        if (rec->value != TRACE_FORMAT_VERSION) {
+          fprintf(stderr, "warning: trace format %u, expected %u\n", rec->value, TRACE_FORMAT_VERSION);
+        }
+        break;
+      case TRACE_EV_PIN_EDGE:
+        if (traceArg(rec) < NUM_GPIO) {
+          if (rec->value) {
+            chip->inputs |= (1 << traceArg(rec));
+          } else {
+            chip->inputs &= ~(1 << traceArg(rec));
+          }
+          chip->seenInputs |= (1 << traceArg(rec));
+          resolvePins(c);
+        }
+        break;
+      case TRACE_EV_DIRECTION:
+        chip->config = rec->value;
+        dumpTime();
+        dumpVector(c, VAR_CONFIG, chip->config, 16);
+        resolvePins(c);
+        break;
+      case TRACE_EV_OUTPUT:
+        chip->output = rec->value;
+        resolvePins(c);
+        break;
+      case TRACE_EV_INT:
+        if (chip->intAsserted != (rec->value != 0)) {
+          chip->intAsserted = (rec->value != 0);
+          dumpTime();
+          dumpBit(c, VAR_NINT, ! chip->intAsserted);
+        }
+        break;
+      case TRACE_EV_I2C_CONNECT:
+        dumpTime();
+        dumpBit(c, VAR_I2C_BUSY, true);
+        break;
+      case TRACE_EV_I2C_WRITE:
+        dumpTime();
+        dumpVector(c, VAR_I2C_WRITE, rec->value, 8);
+        break;
+      case TRACE_EV_I2C_READ:
+        dumpTime();
+        dumpVector(c, VAR_I2C_READ, rec->value, 8);
+        break;
+      case TRACE_EV_I2C_DISCONNECT:
+        dumpTime();
+        dumpBit(c, VAR_I2C_BUSY, false);
+        break;
+      default:
+        break;
+    }
+  }
+
+  fprintf(stderr, "%zu records, %llu ns\n", numRecords, (unsigned long long)now);
+  traceLogFree(&traceLog);
+  return 0;
+}